@@ -1,8 +1,31 @@
 #include "Compiler.h"
 
+#include <fstream>
+#include <sstream>
+#include <cstdarg>
+
 using namespace DevonC;
 
-int Compiler::TypeSize(VarType _Type)
+static bool IsDebugLogOn = true;
+
+int DevonC::DebugLog(const char* _Format, ...)
+{
+	if (!IsDebugLogOn)
+		return 0;
+
+	va_list Args;
+	va_start(Args, _Format);
+	const int Ret = vprintf(_Format, Args);
+	va_end(Args);
+	return Ret;
+}
+
+void DevonC::SetDebugLog(bool _IsOn)
+{
+	IsDebugLogOn = _IsOn;
+}
+
+int Compiler::TypeSize(VarType _Type, int _Struct)
 {
 	switch (_Type)
 	{
@@ -12,10 +35,112 @@ int Compiler::TypeSize(VarType _Type)
 	case VarType::Short:	return 2;
 	case VarType::Pointer:	return 4;
 	case VarType::Int:		return 4;
+	case VarType::Struct:	return _Struct >= 0 ? Structs[_Struct].Size : -1;
 	default:				return -1;
 	}
 }
 
+// Size of one element of an array, or of the variable itself.
+int Compiler::ElemSize(const Variable& _Var)
+{
+	return TypeSize(_Var.PointerIndirection > 0 ? VarType::Pointer : _Var.IsNarrowed ? VarType::Short : _Var.Type, _Var.Struct);
+}
+
+int Compiler::VarSize(const Variable& _Var)
+{
+	int Size = ElemSize(_Var);
+	for (auto ArraySize : _Var.ArraySizes)
+		Size *= ArraySize;
+
+	return Size;
+}
+
+int Compiler::VarAlign(const Variable& _Var)
+{
+	// Anything wider than a byte sits on a 16-bit word boundary, a struct as its widest member does.
+	if (_Var.Type == VarType::Struct && _Var.PointerIndirection == 0 && _Var.Struct >= 0)
+		return Structs[_Var.Struct].Align;
+
+	return ElemSize(_Var) > 1 ? 2 : 1;
+}
+
+int Compiler::ArgSlotsSize(const Function& _Func)
+{
+	// Arguments are pushed as whole 16-bit words.
+	int Size = 0;
+	for (const auto& Param : _Func.Params)
+		Size += (VarSize(Param) + 1) & ~1;
+
+	return Size;
+}
+
+Function* Compiler::FindFunction(const std::string& _Identifier)
+{
+	for (auto& Func : Functions)
+		if (Func.Identifier == _Identifier)
+			return &Func;
+
+	return nullptr;
+}
+
+bool Compiler::FindVar(const std::string& _Identifier, VarRef& _Ref)
+{
+	if (CurFunction >= 0)
+	{
+		const Function& Func = Functions[CurFunction];
+		for (auto ScopeIt = ScopeStack.rbegin(); ScopeIt != ScopeStack.rend(); ++ScopeIt)
+		{
+			const auto& Vars = Func.Scopes[*ScopeIt].Variables;
+			for (int i = int(Vars.size()) - 1; i >= 0; i--)
+			{
+				if (Vars[i].Identifier == _Identifier)
+				{
+					_Ref = { CurFunction, *ScopeIt, i };
+					return true;
+				}
+			}
+		}
+
+		for (int i = 0; i < int(Func.Params.size()); i++)
+		{
+			if (Func.Params[i].Identifier == _Identifier)
+			{
+				_Ref = { CurFunction, -1, i };
+				return true;
+			}
+		}
+	}
+
+	for (int i = 0; i < int(GlobalVars.size()); i++)
+	{
+		if (GlobalVars[i].Identifier == _Identifier)
+		{
+			_Ref = { -1, -1, i };
+			return true;
+		}
+	}
+
+	return false;
+}
+
+Variable& Compiler::GetVar(const VarRef& _Ref)
+{
+	if (_Ref.Function < 0)
+		return GlobalVars[_Ref.Index];
+
+	Function& Func = Functions[_Ref.Function];
+	return _Ref.Scope < 0 ? Func.Params[_Ref.Index] : Func.Scopes[_Ref.Scope].Variables[_Ref.Index];
+}
+
+static std::string LeadingId(const std::string& _Str)
+{
+	size_t End = 0;
+	while (End < _Str.size() && (isalnum((unsigned char)_Str[End]) || _Str[End] == '_'))
+		End++;
+
+	return _Str.substr(0, End);
+}
+
 void Compiler::ErrorMessage(EErrorCode ErrorCode, size_t line)
 {
 	std::cout << IncludeStack.top() << " Line " << line << " : ";
@@ -33,23 +158,79 @@ void Compiler::ErrorMessage(EErrorCode ErrorCode, size_t line)
 	case EErrorCode::BadInitializerLiteralType:
 		std::cout << "Initializer literal is incompatible with the type of the variable being declared.";
 		break;
+
+	case EErrorCode::FuncSignatureMismatch:
+		std::cout << "Declaration of '" << LastFuncId << "' does not match its previous declaration.";
+		break;
+
+	case EErrorCode::DuplicateCase:
+		std::cout << "Duplicate case value " << LastCaseValue << " in switch.";
+		break;
+
+	case EErrorCode::DuplicateDefault:
+		std::cout << "Multiple default labels in one switch.";
+		break;
+
+	case EErrorCode::UnknownStruct:
+		std::cout << "Unknown struct '" << LastStructId << "'.";
+		break;
+
+	case EErrorCode::DuplicateStruct:
+		std::cout << "Struct '" << LastStructId << "' is already defined.";
+		break;
+
+	case EErrorCode::IncompleteStruct:
+		std::cout << "Struct '" << LastStructId << "' is used by value before its definition is complete.";
+		break;
+
+	case EErrorCode::DuplicateMember:
+		std::cout << "Duplicate member '" << LastMemberId << "' in struct '" << LastStructId << "'.";
+		break;
+
+	case EErrorCode::UnknownMember:
+		if (LastStructId.empty())
+			std::cout << "Member '" << LastMemberId << "' accessed on a value that is not a struct.";
+		else
+			std::cout << "Struct '" << LastStructId << "' has no member '" << LastMemberId << "'.";
+		break;
 	}
 
 	std::cout << std::endl;
 	++NbErrors;
 }
 
+void Compiler::PreprocessorError(const std::string& _Path, size_t _Line, const std::string& _Message)
+{
+	std::cout << _Path << " Line " << _Line << " : " << _Message << std::endl;
+	++NbErrors;
+}
+
 bool Compiler::Compile(const char * _Filename)
 {
+	// Macros carry over from a file to the ones it includes and back, so the whole translation unit goes
+	// through the preprocessor first, in include order. The parser then takes the files in that same order.
+	if (IncludeStack.empty())
+	{
+		PreprocessorHost Host;
+		Host.Load = [this](const std::string& _Path) { return Prefetch(_Path).get(); };
+		Host.FindInclude = [this](const std::string& _Name, const std::string& _Includer, bool _IsAngle)
+		{
+			const std::string Path = Includes.Find(_Name, _Includer, _IsAngle);
+			return Path.empty() ? _Name : Path;
+		};
+		Host.Error = [this](const std::string& _Path, size_t _Line, const std::string& _Message) { PreprocessorError(_Path, _Line, _Message); };
+
+		PreprocessedFiles.clear();
+		Macros.Run(_Filename, Host, PreprocessedFiles);
+	}
+
 	IncludeStack.push(_Filename);
 	
 	bool Ret = true;
 
 	try
 	{
-		std::string PreProcessedStr;
-		file_input FileInput(_Filename);
-		parse<preprocess, maction, mcontrol>(FileInput, PreProcessedStr);
+		const std::string PreProcessedStr = TakePreprocessed(_Filename);
 
 		string_input PreProcessedStrInput(PreProcessedStr, "");
 		parse<program, maction, mcontrol>(PreProcessedStrInput, *this);
@@ -62,9 +243,122 @@ bool Compiler::Compile(const char * _Filename)
 
 	IncludeStack.pop();
 
+	if (IncludeStack.empty())
+		WaitPrefetches();
+
 	return Ret;
 }
 
+// Read errors come out here, where the parser reports them against the #include.
+std::string Compiler::TakePreprocessed(const std::string& _Filename)
+{
+	if (PreprocessedFiles.empty() || PreprocessedFiles.front().Path != _Filename)
+		throw std::runtime_error("no preprocessed source for \"" + _Filename + "\"");
+
+	PreprocessedFile File = std::move(PreprocessedFiles.front());
+	PreprocessedFiles.pop_front();
+
+	if (!File.Error.empty())
+		throw std::runtime_error(File.Error);
+	return std::move(File.Text);
+}
+
+// Queues the file to be read and stripped of its comments in the background, then the files it includes.
+// Macros are expanded and files parsed on the calling thread only, in include order, so declarations and
+// diagnostics come in the same order as without prefetching. Read errors are kept in the future and thrown by get().
+std::shared_future<std::string> Compiler::Prefetch(const std::string& _Filename)
+{
+	std::lock_guard<std::mutex> Lock(PrefetchMutex);
+
+	const auto It = Prefetched.find(_Filename);
+	if (It != Prefetched.end())
+		return It->second;
+
+	PrefetchQueue.emplace_back(_Filename, std::promise<std::string>());
+	std::shared_future<std::string> Source = PrefetchQueue.back().second.get_future().share();
+	Prefetched.emplace(_Filename, Source);
+
+	// As many threads as -j allows : a header including hundreds of others does not start hundreds of them.
+	if (int(PrefetchThreads.size()) < NbThreads)
+		PrefetchThreads.emplace_back(&Compiler::PrefetchWorker, this);
+	PrefetchReady.notify_one();
+
+	return Source;
+}
+
+// Takes queued files until WaitPrefetches() stops the threads. Reading a file only queues the ones it
+// includes and never waits on them, so a full pool cannot deadlock.
+void Compiler::PrefetchWorker()
+{
+	std::unique_lock<std::mutex> Lock(PrefetchMutex);
+	for (;;)
+	{
+		PrefetchReady.wait(Lock, [this]() { return StopPrefetch || !PrefetchQueue.empty(); });
+		if (PrefetchQueue.empty())
+			return;
+
+		auto File = std::move(PrefetchQueue.front());
+		PrefetchQueue.pop_front();
+		NbPrefetching++;
+		Lock.unlock();
+
+		try
+		{
+			std::string PreProcessedStr;
+			file_input FileInput(File.first);
+			parse<preprocess, maction, mcontrol>(FileInput, PreProcessedStr);
+
+			PrefetchIncludes(PreProcessedStr, File.first);
+			File.second.set_value(std::move(PreProcessedStr));
+		}
+		catch (...)
+		{
+			File.second.set_exception(std::current_exception());
+		}
+
+		Lock.lock();
+		NbPrefetching--;
+		PrefetchDone.notify_all();
+	}
+}
+
+void Compiler::PrefetchIncludes(const std::string& _Source, const std::string& _Filename)
+{
+	IncludeScan Scan;
+	string_input SourceInput(_Source, "");
+	parse<prefetchscan, prefetchaction>(SourceInput, Scan);
+
+	for (const auto& Include : Scan.Includes)
+	{
+		const std::string Path = Includes.Find(Include.first, _Filename, Include.second);
+		if (!Path.empty())
+			Prefetch(Path);
+	}
+}
+
+// Falls back to the name as written when the file is nowhere to be found, so that opening it fails as usual.
+std::string Compiler::FindInclude(const std::string& _Filename, bool _IsAngle)
+{
+	const std::string Path = Includes.Find(_Filename, IncludeStack.top(), _IsAngle);
+	return Path.empty() ? _Filename : Path;
+}
+
+// Files included from code that never got parsed may still be loading : wait for them, and for whatever
+// they include, then stop the threads, so that no background work outlives the compilation.
+void Compiler::WaitPrefetches()
+{
+	std::unique_lock<std::mutex> Lock(PrefetchMutex);
+	PrefetchDone.wait(Lock, [this]() { return PrefetchQueue.empty() && NbPrefetching == 0; });
+	StopPrefetch = true;
+	PrefetchReady.notify_all();
+	Lock.unlock();
+
+	for (auto& Thread : PrefetchThreads)
+		Thread.join();
+	PrefetchThreads.clear();
+	StopPrefetch = false;
+}
+
 void Compiler::SetCurLiteral(LiteralType _Type, int _Value)
 {
 	CurLiteralValue = _Value;
@@ -79,47 +373,1578 @@ void Compiler::PushPendingVarDecl(const size_t line)
 		CurVarDecl.Type = VarType::Int;
 	}
 
+	ValidateStructType(CurVarDecl, line);
+
 	if (CurVarDecl.StaticInit.has_value()
 		&& CurVarDecl.PointerIndirection > 0
 		&& CurLiteralType != LiteralType::Nullptr
 		)
 		ErrorMessage(EErrorCode::BadInitializerLiteralType, line);
 
+	// Structs are zero-initialized : there is no aggregate initializer yet.
+	if (CurVarDecl.StaticInit.has_value() && CurVarDecl.Type == VarType::Struct && CurVarDecl.PointerIndirection == 0)
+	{
+		ErrorMessage(EErrorCode::BadInitializerLiteralType, line);
+		CurVarDecl.StaticInit.reset();
+	}
+
 	PendingVarDecls.push_back(std::move(CurVarDecl));
 }
 
+// Struct types are looked up as they are parsed, even in a declaration that turns out to be something else :
+// errors wait for the declaration to be complete. A bad struct type is replaced by int, as void is.
+void Compiler::SetStructType(const std::string& _Identifier)
+{
+	LastStructId = _Identifier;
+	CurVarDecl.Type = VarType::Struct;
+	CurVarDecl.Struct = -1;
+	CurVarDecl.PointerIndirection = 0;
+	for (int i = 0; i < int(Structs.size()); i++)
+		if (Structs[i].Identifier == _Identifier)
+			CurVarDecl.Struct = i;
+}
+
+void Compiler::ValidateStructType(Variable& _Var, size_t _Line)
+{
+	if (_Var.Type != VarType::Struct)
+		return;
+
+	if (_Var.Struct >= 0 && (_Var.PointerIndirection > 0 || Structs[_Var.Struct].IsComplete))
+		return;
+
+	if (_Var.Struct >= 0)
+		LastStructId = Structs[_Var.Struct].Identifier;
+	ErrorMessage(_Var.Struct < 0 ? EErrorCode::UnknownStruct : EErrorCode::IncompleteStruct, _Line);
+	_Var.Type = VarType::Int;
+	_Var.Struct = -1;
+}
+
+void Compiler::BeginStruct(const std::string& _Identifier, size_t _Line)
+{
+	for (const auto& Struct : Structs)
+	{
+		if (Struct.Identifier == _Identifier)
+		{
+			LastStructId = _Identifier;
+			ErrorMessage(EErrorCode::DuplicateStruct, _Line);
+			break;
+		}
+	}
+
+	// A redefinition is parsed into a struct of its own, that nothing can name.
+	StructType Struct;
+	Struct.Identifier = _Identifier;
+	Struct.IsReordered = PendingReorder;
+	Struct.Line = _Line;
+	Structs.push_back(std::move(Struct));
+
+	PendingReorder = false;
+	PendingVarDecls.clear();
+}
+
+void Compiler::PushStructFields()
+{
+	if (!Structs.empty() && !Structs.back().IsComplete)
+	{
+		auto& Fields = Structs.back().Fields;
+		for (auto& Field : PendingVarDecls)
+		{
+			if (std::any_of(Fields.begin(), Fields.end(), [&Field](const Variable& _Other) { return _Other.Identifier == Field.Identifier; }))
+			{
+				LastStructId = Structs.back().Identifier;
+				LastMemberId = Field.Identifier;
+				ErrorMessage(EErrorCode::DuplicateMember, Structs.back().Line);
+				continue;
+			}
+
+			Field.StaticInit.reset();
+			Fields.push_back(std::move(Field));
+		}
+	}
+	PendingVarDecls.clear();
+}
+
+void Compiler::EndStruct()
+{
+	if (Structs.empty())
+		return;
+
+	StructType& Struct = Structs.back();
+	Struct.IsComplete = true;
+
+	std::vector<int> Order(Struct.Fields.size());
+	for (int i = 0; i < int(Order.size()); i++)
+		Order[i] = i;
+	LayoutStruct(Struct, Order);
+	Struct.DeclOrderSize = Struct.Size;
+
+	// Only the definition picks the order, so that every translation unit including it agrees on the layout,
+	// and structs containing this one, defined after it, see its final size. Word-aligned fields go first,
+	// in declaration order, then the byte-sized ones : no padding is left but at the end.
+	if (Struct.IsReordered)
+	{
+		std::stable_sort(Order.begin(), Order.end(), [this, &Struct](int _A, int _B) { return VarAlign(Struct.Fields[_A]) > VarAlign(Struct.Fields[_B]); });
+		LayoutStruct(Struct, Order);
+	}
+}
+
 void Compiler::ValidateGlobalVar()
 {
+	for (auto& Var : PendingVarDecls)
+		Var.IsStatic = PendingStatic;
 	GlobalVars.insert(GlobalVars.end(), PendingVarDecls.begin(), PendingVarDecls.end());
 	PendingVarDecls.clear();
 }
 
-void Compiler::DumpDebug()
+void Compiler::ValidateLocalVar()
 {
-	std::cout << "\nGlobals:\n";
-	for (auto var : GlobalVars)
+	if (CurFunction >= 0 && !ScopeStack.empty())
+	{
+		auto& Vars = Functions[CurFunction].Scopes[ScopeStack.back()].Variables;
+		Vars.insert(Vars.end(), PendingVarDecls.begin(), PendingVarDecls.end());
+	}
+	PendingVarDecls.clear();
+}
+
+void Compiler::OpenScope()
+{
+	if (CurFunction < 0)
+		return;
+
+	auto& Func = Functions[CurFunction];
+	if (ScopeStack.empty())
+	{
+		// Function body : a body parsed again after a failed attempt starts from scratch.
+		Func.Scopes.clear();
+		Func.TailCalls.clear();
+		Func.Uses.clear();
+		Func.Calls.clear();
+		Func.DeadCode.clear();
+		Func.Loops.clear();
+		Func.Conditionals.clear();
+		Func.Labels.clear();
+		Func.Values.clear();
+		Func.Switches.clear();
+		SwitchStack.clear();
+		Func.HasLabels = false;
+
+		const int FuncIndex = CurFunction;
+		RangeDefs.erase(std::remove_if(RangeDefs.begin(), RangeDefs.end(), [FuncIndex](const RangeDef& Def) { return Def.InFunction == FuncIndex; }), RangeDefs.end());
+	}
+
+	auto& Scopes = Func.Scopes;
+	Scopes.emplace_back();
+	Scopes.back().Parent = ScopeStack.empty() ? -1 : ScopeStack.back();
+	ScopeStack.push_back(int(Scopes.size()) - 1);
+}
+
+void Compiler::CloseScope()
+{
+	if (!ScopeStack.empty())
+		ScopeStack.pop_back();
+}
+
+void Compiler::BeginFuncDecl()
+{
+	CurFuncDecl = CurVarDecl;
+	PendingParams.clear();
+}
+
+void Compiler::PushFuncParam(const size_t line)
+{
+	if (CurVarDecl.Type == VarType::Void && CurVarDecl.PointerIndirection == 0)
+	{
+		ErrorMessage(EErrorCode::VoidVarDecl, line);
+		CurVarDecl.Type = VarType::Int;
+	}
+
+	ValidateStructType(CurVarDecl, line);
+
+	PendingParams.push_back(std::move(CurVarDecl));
+}
+
+void Compiler::DeclareFunction(const size_t line)
+{
+	ValidateStructType(CurFuncDecl, line);
+
+	Function* Func = FindFunction(LastFuncId);
+	if (Func == nullptr)
+	{
+		Functions.emplace_back(LastFuncId);
+		Func = &Functions.back();
+	}
+	else
+	{
+		bool Match = Func->Params.size() == PendingParams.size()
+			&& Func->ReturnType.Type == CurFuncDecl.Type
+			&& Func->ReturnType.Struct == CurFuncDecl.Struct
+			&& Func->ReturnType.PointerIndirection == CurFuncDecl.PointerIndirection;
+
+		for (size_t i = 0; Match && i < PendingParams.size(); i++)
+			Match = Func->Params[i].Type == PendingParams[i].Type
+				&& Func->Params[i].Struct == PendingParams[i].Struct
+				&& Func->Params[i].PointerIndirection == PendingParams[i].PointerIndirection;
+
+		if (!Match)
+			ErrorMessage(EErrorCode::FuncSignatureMismatch, line);
+	}
+
+	// Once declared static, a function stays static.
+	Func->IsStatic |= PendingStatic;
+
+	// The latest declaration wins : parameter names of the definition are the ones used by its body.
+	Func->ReturnType = CurFuncDecl;
+	Func->ReturnType.Identifier.clear();
+	Func->Params = std::move(PendingParams);
+	PendingParams.clear();
+
+	ScopeStack.clear();
+
+	CurFunction = int(Func - Functions.data());
+}
+
+void Compiler::DefineFunction()
+{
+	if (CurFunction >= 0)
+		Functions[CurFunction].IsDefined = true;
+}
+
+void Compiler::EndFuncDecl()
+{
+	CurFunction = -1;
+}
+
+void Compiler::PushTailCall(TailCall&& _Call)
+{
+	if (CurFunction >= 0)
+		Functions[CurFunction].TailCalls.push_back(std::move(_Call));
+}
+
+void Compiler::PushAssignment(const std::string& _Assignment, size_t _Pos)
+{
+	VarRef Ref;
+	if (!FindVar(LeadingId(_Assignment), Ref))
+		return;
+
+	// The target was recorded as a read when its lvalue was parsed, it starts where the assignment does.
+	// The store takes place once the right-hand side is computed.
+	if (CurFunction >= 0)
 	{
-		std::cout << "\t";
-		switch (var.Type)
+		auto& Uses = Functions[CurFunction].Uses;
+		for (auto Use = Uses.rbegin(); Use != Uses.rend(); ++Use)
 		{
-		case VarType::Void:		std::cout << "Void";	break;
-		case VarType::Char:		std::cout << "Char";	break;
-		case VarType::Bool:		std::cout << "Bool";	break;
-		case VarType::Short:	std::cout << "Short";	break;
-		case VarType::Int:		std::cout << "Int";		break;
-		default:				std::cout << "Unknown-Type";	break;
+			if (Use->Pos == _Pos)
+			{
+				Use->IsStore = true;
+				Use->End = _Pos + _Assignment.size();
+				break;
+			}
 		}
-		for (int i = 0; i < var.PointerIndirection; i++)
-			std::cout << "*";
-		std::cout << " " << var.Identifier;
 
-		for (auto arraySize : var.ArraySizes)
-			std::cout << "[" << arraySize << "]";
+		auto& Values = Functions[CurFunction].Values;
+		Values.erase(std::remove_if(Values.begin(), Values.end(), [_Pos](const ValueExpr& _Value) { return _Value.Kind == ValueKind::Load && _Value.Pos == _Pos; }), Values.end());
+	}
 
-		if (var.StaticInit.has_value())
-			std::cout << " = " << var.StaticInit.value() << "\n";
+	// Only a plain "v = ..." defines v as a whole, element stores never change an int's range.
+	RangeDef Def;
+	string_input AssignInput(_Assignment, "");
+	if (!parse<rangeassign, rangeaction>(AssignInput, Def))
+		return;
 
-		std::cout << "\n";
+	Def.Var = Ref;
+	Def.InFunction = CurFunction;
+	Def.Pos = _Pos;
+	RangeDefs.push_back(Def);
+}
+
+void Compiler::PushLoopStep(const std::string& _Next)
+{
+	// The assignment of "v = v + k" has just been recorded as an unknown definition : when the loop
+	// condition bounds v, it becomes a bounded step instead.
+	LoopCounter Counter;
+	string_input NextInput(_Next, "");
+	string_input CondInput(LastForCond, "");
+	if (!parse<counterupdate, rangeaction>(NextInput, Counter)
+		|| !parse<countercond, rangeaction>(CondInput, Counter)
+		|| !Counter.IsSameVar || !Counter.IsValid || Counter.Step <= 0
+		|| RangeDefs.empty())
+		return;
+
+	VarRef Ref;
+	RangeDef& Def = RangeDefs.back();
+	if (!FindVar(Counter.Identifier, Ref)
+		|| Def.Var.Function != Ref.Function || Def.Var.Scope != Ref.Scope || Def.Var.Index != Ref.Index)
+		return;
+
+	Def.Kind = RangeDefKind::Step;
+	Def.Step = Counter.IsDecrement ? -Counter.Step : Counter.Step;
+	Def.Value = Counter.Bound + Counter.BoundAdjust;
+}
+
+void Compiler::PushVarAccess(const std::string& _Access, size_t _Pos, size_t _Line)
+{
+	VarRef Ref;
+	if (FindVar(LeadingId(_Access), Ref))
+	{
+		if (PendingAddressOf)
+			GetVar(Ref).IsAddressTaken = true;
+
+		if (CurFunction >= 0)
+		{
+			VarUse Use;
+			Use.Var = Ref;
+			Use.Pos = _Pos;
+			Use.End = _Pos + _Access.size();
+			Use.Line = _Line;
+			ResolveAccess(_Access, Use);
+			Functions[CurFunction].Uses.push_back(std::move(Use));
+		}
+	}
+
+	PendingAddressOf = false;
+
+	if (CurFunction < 0)
+		return;
+
+	// Every prefix of "a[i][j].m[k]" ending on a step is an address : a[i], a[i][j], a[i][j].m, and the whole chain.
+	bool HasStep = false;
+	int Depth = 0;
+	for (size_t i = 0; i < _Access.size(); i++)
+	{
+		const char C = _Access[i];
+		if (Depth == 0 && (C == '[' || C == '.'))
+		{
+			if (HasStep)
+				PushValue(ValueKind::Address, _Access.substr(0, _Access.find_last_not_of(" \t\r\n", i - 1) + 1), _Pos, _Line);
+			HasStep = true;
+		}
+
+		if (C == '[')
+			++Depth;
+		else if (C == ']')
+			--Depth;
+	}
+
+	if (HasStep)
+	{
+		PushValue(ValueKind::Address, _Access, _Pos, _Line);
+		PushValue(ValueKind::Load, _Access, _Pos, _Line);
 	}
 }
 
+// Splits "a[i][2].m[1]" into its steps. Members are found in the struct definitions, which are complete
+// wherever a variable of their type can be declared.
+void Compiler::ResolveAccess(const std::string& _Access, VarUse& _Use)
+{
+	const Variable* Cur = &GetVar(_Use.Var);
+	size_t NbIndices = 0;		// Indices applied to Cur so far.
+	size_t Pos = LeadingId(_Access).size();
+	while (Pos < _Access.size())
+	{
+		const char C = _Access[Pos];
+		if (C == '[')
+		{
+			size_t End = Pos + 1;
+			for (int Depth = 1; End < _Access.size() && Depth > 0; End++)
+				Depth += _Access[End] == '[' ? 1 : _Access[End] == ']' ? -1 : 0;
+
+			AccessStep Step;
+			const size_t First = _Access.find_first_not_of(" \t\r\n", Pos + 1);
+			const size_t Last = _Access.find_last_not_of(" \t\r\n", End - 2);
+			const std::string Index = First <= Last ? _Access.substr(First, Last - First + 1) : "";
+			if (Index.size() == 3 && Index[0] == '\'' && Index[2] == '\'')
+				Step.Index = (unsigned char)Index[1];
+			else if (!Index.empty() && std::all_of(Index.begin(), Index.end(), [](char _C) { return isalnum((unsigned char)_C) != 0; }) && isdigit((unsigned char)Index[0]))
+				Step.Index = int(std::stoll(Index, nullptr, 0));
+			_Use.Steps.push_back(Step);
+
+			NbIndices++;
+			Pos = End;
+		}
+		else if (C == '.')
+		{
+			Pos = _Access.find_first_not_of(" \t\r\n", Pos + 1);
+			if (Pos == std::string::npos)
+				return;
+			LastMemberId = LeadingId(_Access.substr(Pos));
+			Pos += LastMemberId.size();
+
+			// Indexing a pointer reaches its pointee, as indexing an array reaches an element.
+			static const std::vector<Variable> NoFields;
+			const bool IsStruct = Cur->Type == VarType::Struct && Cur->Struct >= 0 && NbIndices == Cur->ArraySizes.size() + Cur->PointerIndirection;
+			LastStructId = IsStruct ? Structs[Cur->Struct].Identifier : "";
+
+			const auto& Fields = IsStruct ? Structs[Cur->Struct].Fields : NoFields;
+			const auto Field = std::find_if(Fields.begin(), Fields.end(), [this](const Variable& _Field) { return _Field.Identifier == LastMemberId; });
+			if (Field == Fields.end())
+			{
+				ErrorMessage(EErrorCode::UnknownMember, _Use.Line);
+				_Use.Steps.clear();
+				return;
+			}
+
+			AccessStep Step;
+			Step.Struct = Cur->Struct;
+			Step.Field = int(Field - Fields.begin());
+			_Use.Steps.push_back(Step);
+
+			Cur = &*Field;
+			NbIndices = 0;
+		}
+		else
+		{
+			Pos++;
+		}
+	}
+}
+
+// Only expressions with an operator outside of any parenthesis or index are worth numbering, the others
+// are a single access or a literal.
+void Compiler::PushExpression(const std::string& _Expression, size_t _Pos, size_t _Line)
+{
+	if (CurFunction < 0)
+		return;
+
+	int Depth = 0;
+	bool IsOperand = true;		// Next '-' or '*' would be unary.
+	for (const char C : _Expression)
+	{
+		if (C == '(' || C == '[')
+			++Depth;
+		else if (C == ')' || C == ']')
+			--Depth;
+		else if (C == ' ' || C == '\t' || C == '\r' || C == '\n')
+			continue;
+		else if (Depth == 0 && strchr("+-*/%", C) != nullptr && !IsOperand)
+		{
+			PushValue(ValueKind::Expression, _Expression, _Pos, _Line);
+			return;
+		}
+
+		IsOperand = strchr("+-*/%&!(", C) != nullptr;
+	}
+}
+
+void Compiler::PushCall(const std::string& _Call, size_t _Pos)
+{
+	if (CurFunction >= 0)
+		Functions[CurFunction].Calls.push_back({ LeadingId(_Call), _Pos, _Pos + _Call.size() });
+}
+
+void Compiler::PushLabel(size_t _Pos)
+{
+	if (CurFunction < 0)
+		return;
+
+	Functions[CurFunction].HasLabels = true;
+	Functions[CurFunction].Labels.push_back(_Pos);
+
+	// Code after a label can be jumped to.
+	if (!ScopeStack.empty())
+		Functions[CurFunction].Scopes[ScopeStack.back()].IsTerminated = false;
+}
+
+void Compiler::PushScopeStatement(const CodeRange& _Statement, bool _IsJump)
+{
+	if (CurFunction < 0 || ScopeStack.empty())
+		return;
+
+	Scope& CurScope = Functions[CurFunction].Scopes[ScopeStack.back()];
+	if (CurScope.IsTerminated)
+		PushDeadCode(_Statement);
+	else if (_IsJump)
+		CurScope.IsTerminated = true;
+}
+
+void Compiler::PushLoop(const CodeRange& _Loop)
+{
+	if (CurFunction >= 0)
+		Functions[CurFunction].Loops.push_back(_Loop);
+}
+
+void Compiler::PushConditional(const CodeRange& _Range)
+{
+	if (CurFunction >= 0)
+		Functions[CurFunction].Conditionals.push_back(_Range);
+}
+
+// The switch body is a scope of its own, and nothing in it runs before the first case label.
+void Compiler::BeginSwitch()
+{
+	if (CurFunction < 0)
+		return;
+
+	OpenScope();
+	Functions[CurFunction].Scopes[ScopeStack.back()].IsTerminated = true;
+
+	auto& Switches = Functions[CurFunction].Switches;
+	Switches.emplace_back();
+	SwitchStack.push_back(int(Switches.size()) - 1);
+}
+
+void Compiler::PushCase(int _Value, size_t _Pos, size_t _Line)
+{
+	if (CurFunction < 0 || SwitchStack.empty())
+		return;
+
+	Switch& Cur = Functions[CurFunction].Switches[SwitchStack.back()];
+	for (const auto& Case : Cur.Cases)
+	{
+		if (Case.Value == _Value)
+		{
+			LastCaseValue = _Value;
+			ErrorMessage(EErrorCode::DuplicateCase, _Line);
+			break;
+		}
+	}
+	Cur.Cases.push_back({ _Value, _Line });
+
+	// Case labels are jumped to from the switch only, which comes first : they do not make the function
+	// a goto target the way labels do.
+	Functions[CurFunction].Labels.push_back(_Pos);
+	Functions[CurFunction].Scopes[ScopeStack.back()].IsTerminated = false;
+}
+
+void Compiler::PushDefault(size_t _Pos, size_t _Line)
+{
+	if (CurFunction < 0 || SwitchStack.empty())
+		return;
+
+	Switch& Cur = Functions[CurFunction].Switches[SwitchStack.back()];
+	if (Cur.HasDefault)
+		ErrorMessage(EErrorCode::DuplicateDefault, _Line);
+	Cur.HasDefault = true;
+
+	Functions[CurFunction].Labels.push_back(_Pos);
+	Functions[CurFunction].Scopes[ScopeStack.back()].IsTerminated = false;
+}
+
+void Compiler::EndSwitch(const CodeRange& _Statement)
+{
+	if (CurFunction < 0 || SwitchStack.empty())
+		return;
+
+	Functions[CurFunction].Switches[SwitchStack.back()].Line = _Statement.Line;
+	SwitchStack.pop_back();
+	CloseScope();
+	PushConditional(_Statement);
+}
+
+static bool IsSameVar(const VarRef& _A, const VarRef& _B)
+{
+	return _A.Function == _B.Function && _A.Scope == _B.Scope && _A.Index == _B.Index;
+}
+
+// Rewrites _Text so that equal keys mean equal values in the current scope : variables become their
+// reference, literals their decimal value, blanks go. Returns an empty key when evaluating _Text has
+// side effects or calls a function.
+std::string Compiler::ValueKey(const std::string& _Text, std::vector<VarRef>& _Deps, bool& _IsIndirect)
+{
+	std::string Key;
+	size_t Pos = 0;
+	auto Next = [&_Text](size_t _From)
+	{
+		while (_From < _Text.size() && isspace((unsigned char)_Text[_From]))
+			_From++;
+		return _From < _Text.size() ? _Text[_From] : '\0';
+	};
+
+	while (Pos < _Text.size())
+	{
+		const char C = _Text[Pos];
+		if (isspace((unsigned char)C))
+		{
+			Pos++;
+		}
+		else if (isalpha((unsigned char)C) || C == '_')
+		{
+			const std::string Identifier = LeadingId(_Text.substr(Pos));
+			const char Prev = Key.empty() ? '\0' : Key.back();
+			Pos += Identifier.size();
+
+			VarRef Ref;
+			if (Next(Pos) == '(')
+				return "";
+			if (Prev == '.' || !FindVar(Identifier, Ref))
+			{
+				Key += Identifier;
+				continue;
+			}
+
+			const Variable& Var = GetVar(Ref);
+			if (Next(Pos) == '[' && Var.PointerIndirection > 0 && Var.ArraySizes.empty())
+				_IsIndirect = true;
+			if (std::none_of(_Deps.begin(), _Deps.end(), [&Ref](const VarRef& _Dep) { return IsSameVar(_Dep, Ref); }))
+				_Deps.push_back(Ref);
+			Key += "@" + std::to_string(Ref.Function) + ":" + std::to_string(Ref.Scope) + ":" + std::to_string(Ref.Index);
+		}
+		else if (isdigit((unsigned char)C) || C == '\'')
+		{
+			size_t End = Pos + 1;
+			long long Value = 0;
+			if (C == '\'')
+			{
+				Value = Pos + 1 < _Text.size() ? (unsigned char)_Text[Pos + 1] : 0;
+				End = std::min(_Text.size(), Pos + 3);
+			}
+			else
+			{
+				while (End < _Text.size() && isalnum((unsigned char)_Text[End]))
+					End++;
+				Value = std::stoll(_Text.substr(Pos, End - Pos), nullptr, 0);
+			}
+			Key += std::to_string(Value);
+			Pos = End;
+		}
+		else
+		{
+			// A lone '=' is an assignment, the relational operators are parsed separately.
+			if (C == '=' && Next(Pos + 1) != '=' && (Key.empty() || strchr("=!<>", Key.back()) == nullptr))
+				return "";
+			if (C == '*' && (Key.empty() || strchr("+-*/%&!([,", Key.back()) != nullptr))
+				_IsIndirect = true;
+			Key += C;
+			Pos++;
+		}
+	}
+
+	return Key;
+}
+
+void Compiler::PushValue(ValueKind _Kind, const std::string& _Text, size_t _Pos, size_t _Line)
+{
+	ValueExpr Value;
+	Value.Kind = _Kind;
+	Value.Text = _Text;
+	Value.Pos = _Pos;
+	Value.End = _Pos + _Text.size();
+	Value.Line = _Line;
+	Value.Key = ValueKey(_Text, Value.Deps, Value.IsIndirect);
+	if (Value.Key.empty() || Value.Deps.empty())
+		return;
+
+	// The address of an element does not depend on what the array holds, only a pointer's value matters.
+	if (_Kind == ValueKind::Address)
+	{
+		VarRef Base;
+		if (FindVar(LeadingId(_Text), Base) && (GetVar(Base).PointerIndirection == 0 || !GetVar(Base).ArraySizes.empty()))
+		{
+			Value.Deps.erase(std::remove_if(Value.Deps.begin(), Value.Deps.end(), [&Base](const VarRef& _Dep) { return IsSameVar(_Dep, Base); }), Value.Deps.end());
+			if (Value.Deps.empty())
+				return;		// Constant indices : the address is known at link time.
+		}
+	}
+
+	// A sum of a single product is the product again.
+	auto& Values = Functions[CurFunction].Values;
+	if (!Values.empty() && Values.back().Kind == _Kind && Values.back().Pos == Value.Pos && Values.back().End == Value.End)
+		return;
+
+	const char* Prefix[] = { "A:", "L:", "E:" };
+	Value.Key = Prefix[int(_Kind)] + Value.Key;
+	Values.push_back(std::move(Value));
+}
+
+void Compiler::PushDeadCode(const CodeRange& _Range)
+{
+	if (CurFunction < 0)
+		return;
+
+	DLOG("UNREACHABLE : line %zu\n", _Range.Line);
+	Functions[CurFunction].DeadCode.push_back(_Range);
+}
+
+bool Compiler::IsDeadCode(const Function& _Func, size_t _Pos) const
+{
+	for (const auto& Range : _Func.DeadCode)
+		if (_Pos >= Range.Begin && _Pos < Range.End)
+			return true;
+
+	return false;
+}
+
+// Unreachable statements, static functions no visible function calls, and locals and static globals live
+// code never reads are dropped. Their records stay, the other passes skip them. Functions and globals that
+// are not static may be used by other objects : they are kept, and the linker drops them if no object does.
+void Compiler::EliminateDeadCode()
+{
+	for (auto& Func : Functions)
+	{
+		// A label in an unreachable range can still be jumped to.
+		auto HasLabel = [&Func](const CodeRange& Range)
+		{
+			return std::any_of(Func.Labels.begin(), Func.Labels.end(), [&Range](size_t Label) { return Label >= Range.Begin && Label < Range.End; });
+		};
+		Func.DeadCode.erase(std::remove_if(Func.DeadCode.begin(), Func.DeadCode.end(), HasLabel), Func.DeadCode.end());
+	}
+
+	std::vector<Function*> ToVisit;
+	for (auto& Func : Functions)
+	{
+		Func.IsLive = !Func.IsStatic;
+		if (Func.IsLive)
+			ToVisit.push_back(&Func);
+	}
+
+	while (!ToVisit.empty())
+	{
+		const Function* Func = ToVisit.back();
+		ToVisit.pop_back();
+
+		for (const auto& Call : Func->Calls)
+		{
+			Function* Callee = FindFunction(Call.Callee);
+			if (Callee != nullptr && !Callee->IsLive && !IsDeadCode(*Func, Call.Pos))
+			{
+				Callee->IsLive = true;
+				ToVisit.push_back(Callee);
+			}
+		}
+	}
+
+	for (auto& Var : GlobalVars)
+		Var.IsUnused = Var.IsStatic;
+
+	for (auto& Func : Functions)
+		for (auto& Scope : Func.Scopes)
+			for (auto& Var : Scope.Variables)
+				Var.IsUnused = true;
+
+	for (auto& Func : Functions)
+	{
+		if (!Func.IsLive)
+			continue;
+
+		// Only a store to the whole variable leaves it unread : an element or member store may go through a
+		// pointer it holds, which reads it to reach memory the store changes for good.
+		for (const auto& Use : Func.Uses)
+			if ((!Use.IsStore || !Use.Steps.empty()) && !IsDeadCode(Func, Use.Pos))
+				GetVar(Use.Var).IsUnused = false;
+	}
+}
+
+// A "return f(...);" becomes a jump to f when f hands back exactly what the caller returns, and f's
+// arguments fit in the caller's own incoming argument slots : they are overwritten in place, no frame
+// is pushed, and chains of such calls (including self-recursion) run in constant stack.
+// The jump frees the caller's frame before f runs : a caller whose locals or parameters may be pointed
+// to, having their address taken or being arrays passed by address, keeps its calls.
+void Compiler::ResolveTailCalls(Function& _Func)
+{
+	const int FuncIndex = int(&_Func - Functions.data());
+	bool HasEscapingLocal = false;
+	for (int i = 0; i < int(_Func.Params.size()); i++)
+		HasEscapingLocal |= IsEscaping({ FuncIndex, -1, i });
+	for (int s = 0; s < int(_Func.Scopes.size()); s++)
+		for (int i = 0; i < int(_Func.Scopes[s].Variables.size()); i++)
+			HasEscapingLocal |= IsEscaping({ FuncIndex, s, i });
+
+	for (auto& Call : _Func.TailCalls)
+	{
+		const Function* Callee = FindFunction(Call.Callee);
+		Call.IsJump = !HasEscapingLocal
+			&& Callee != nullptr
+			&& int(Callee->Params.size()) == Call.NbArgs
+			&& Callee->ReturnType.Type == _Func.ReturnType.Type
+			&& Callee->ReturnType.PointerIndirection == _Func.ReturnType.PointerIndirection
+			&& Callee->ReturnType.Struct == _Func.ReturnType.Struct
+			&& ArgSlotsSize(*Callee) <= ArgSlotsSize(_Func);
+	}
+}
+
+// An int only ever holding values that fit in 16 bits is narrowed to a Short : loads sign-extend it
+// back, so every expression using it still computes the same value.
+void Compiler::NarrowRange(Variable& _Var, const VarRef& _Ref)
+{
+	if (_Var.Type != VarType::Int || _Var.PointerIndirection > 0 || !_Var.ArraySizes.empty() || _Var.IsAddressTaken)
+		return;
+
+	// Parameters get whatever the callers pass, and other objects may store anything in a global they see.
+	if ((_Ref.Function >= 0 && _Ref.Scope < 0) || (_Ref.Function < 0 && !_Var.IsStatic))
+		return;
+
+	// Globals start at their initializer or zero, uninitialized locals hold nothing worth tracking.
+	long long Min = 0, Max = 0;
+	bool HasValue = _Ref.Function < 0 || _Var.StaticInit.has_value();
+	if (HasValue)
+		Min = Max = _Var.StaticInit.value_or(0);
+
+	const RangeDef* StepDef = nullptr;
+	for (const auto& Def : RangeDefs)
+	{
+		if (Def.Var.Function != _Ref.Function || Def.Var.Scope != _Ref.Scope || Def.Var.Index != _Ref.Index)
+			continue;
+
+		if (Def.InFunction >= 0 && (!Functions[Def.InFunction].IsLive || IsDeadCode(Functions[Def.InFunction], Def.Pos)))
+			continue;
+
+		switch (Def.Kind)
+		{
+		case RangeDefKind::Unknown:
+			return;
+
+		case RangeDefKind::Constant:
+			Min = HasValue ? std::min<long long>(Min, Def.Value) : Def.Value;
+			Max = HasValue ? std::max<long long>(Max, Def.Value) : Def.Value;
+			HasValue = true;
+			break;
+
+		case RangeDefKind::Step:
+			// A goto into the loop body would skip the loop condition, and two steps feed each other.
+			if (StepDef != nullptr || Functions[_Ref.Function].HasLabels)
+				return;
+			StepDef = &Def;
+			break;
+		}
+	}
+
+	if (!HasValue)
+		return;
+
+	// The step only runs on values that passed the loop condition or come from another definition.
+	if (StepDef != nullptr)
+	{
+		if (StepDef->Step > 0)
+			Max = std::max(Max, std::max<long long>(StepDef->Value, Max) + StepDef->Step);
+		else
+			Min = std::min(Min, std::min<long long>(StepDef->Value, Min) + StepDef->Step);
+	}
+
+	if (Min >= -32768 && Max <= 32767)
+	{
+		_Var.IsNarrowed = true;
+		DLOG("NARROWED : %s [%lld, %lld]\n", _Var.Identifier.c_str(), Min, Max);
+	}
+}
+
+void Compiler::NarrowRanges()
+{
+	for (int i = 0; i < int(GlobalVars.size()); i++)
+		NarrowRange(GlobalVars[i], { -1, -1, i });
+
+	for (int f = 0; f < int(Functions.size()); f++)
+		for (int s = 0; s < int(Functions[f].Scopes.size()); s++)
+			for (int i = 0; i < int(Functions[f].Scopes[s].Variables.size()); i++)
+				NarrowRange(Functions[f].Scopes[s].Variables[i], { f, s, i });
+}
+
+// Sibling scopes are never live at the same time : each one starts where its parent's own variables
+// end, so they overlap in the frame and the frame only needs the deepest path through the scope tree.
+int Compiler::LayoutScope(Function& _Func, int _ScopeIndex, int _Base)
+{
+	int Offset = _Base;
+	for (auto& Var : _Func.Scopes[_ScopeIndex].Variables)
+	{
+		if (Var.IsUnused)
+			continue;
+
+		const int Align = VarAlign(Var);
+		Offset = (Offset + Align - 1) / Align * Align;
+		Var.Offset = Offset;
+		Offset += VarSize(Var);
+	}
+
+	int End = Offset;
+	for (int i = _ScopeIndex + 1; i < int(_Func.Scopes.size()); i++)
+		if (_Func.Scopes[i].Parent == _ScopeIndex)
+			End = std::max(End, LayoutScope(_Func, i, Offset));
+
+	return End;
+}
+
+void Compiler::LayoutFrame(Function& _Func)
+{
+	// Naive layout : one slot per local, whatever its scope.
+	int Naive = 0;
+	for (const auto& Scope : _Func.Scopes)
+	{
+		for (const auto& Var : Scope.Variables)
+		{
+			const int Align = VarAlign(Var);
+			Naive = (Naive + Align - 1) / Align * Align + VarSize(Var);
+		}
+	}
+	_Func.NaiveFrameSize = (Naive + 1) & ~1;
+
+	_Func.FrameSize = _Func.Scopes.empty() ? 0 : (LayoutScope(_Func, 0, 0) + 1) & ~1;
+}
+
+// Variables a call may change, or read through a pointer : globals, locals whose address is taken, and
+// local arrays, which are passed by address.
+bool Compiler::IsEscaping(const VarRef& _Ref)
+{
+	const Variable& Var = GetVar(_Ref);
+	return _Ref.Function < 0 || Var.IsAddressTaken || !Var.ArraySizes.empty();
+}
+
+// Values are numbered in the order their computation completes. A value computed again, with no store to
+// what it reads in between, reuses the first computation. Stores drop the values reading the variable,
+// calls drop those reading escaping variables, and stores to memory drop the values read through pointers.
+// A pointer may point to any escaping variable, so a store through one drops the values reading those as well.
+// Control flow is followed conservatively : values computed in code that may not run, which includes while
+// and for bodies, are dropped at its end, entering a loop drops the values the loop changes, and a label
+// drops everything.
+void Compiler::NumberValues(Function& _Func)
+{
+	enum class EventKind : unsigned char
+	{
+		Label,
+		Value,
+		Store,
+		Call,
+		ConditionalEnd,
+	};
+
+	struct Event
+	{
+		size_t At;
+		EventKind Kind;
+		size_t Index;
+	};
+
+	_Func.Reuses.clear();
+	if (_Func.Values.empty())
+		return;
+
+	std::vector<Event> Events;
+	for (size_t i = 0; i < _Func.Labels.size(); i++)
+		Events.push_back({ _Func.Labels[i], EventKind::Label, i });
+	for (size_t i = 0; i < _Func.Values.size(); i++)
+		if (!IsDeadCode(_Func, _Func.Values[i].Pos))
+			Events.push_back({ _Func.Values[i].End, EventKind::Value, i });
+	for (size_t i = 0; i < _Func.Uses.size(); i++)
+		if (_Func.Uses[i].IsStore && !IsDeadCode(_Func, _Func.Uses[i].Pos))
+			Events.push_back({ _Func.Uses[i].End, EventKind::Store, i });
+	for (size_t i = 0; i < _Func.Calls.size(); i++)
+		if (!IsDeadCode(_Func, _Func.Calls[i].Pos))
+			Events.push_back({ _Func.Calls[i].End, EventKind::Call, i });
+	for (size_t i = 0; i < _Func.Conditionals.size(); i++)
+		Events.push_back({ _Func.Conditionals[i].End, EventKind::ConditionalEnd, i });
+
+	std::stable_sort(Events.begin(), Events.end(), [](const Event& _A, const Event& _B)
+	{
+		return _A.At != _B.At ? _A.At < _B.At : _A.Kind < _B.Kind;
+	});
+
+	std::unordered_map<std::string, int> Available;
+	auto Drop = [&](auto&& _Pred)
+	{
+		for (auto It = Available.begin(); It != Available.end();)
+			It = _Pred(_Func.Values[It->second]) ? Available.erase(It) : std::next(It);
+	};
+
+	auto DependsOn = [](const ValueExpr& _Value, const VarRef& _Ref)
+	{
+		return std::any_of(_Value.Deps.begin(), _Value.Deps.end(), [&_Ref](const VarRef& _Dep) { return IsSameVar(_Dep, _Ref); });
+	};
+
+	auto DependsOnEscaping = [this](const ValueExpr& _Value)
+	{
+		return std::any_of(_Value.Deps.begin(), _Value.Deps.end(), [this](const VarRef& _Dep) { return IsEscaping(_Dep); });
+	};
+
+	auto DropStore = [&](const VarRef& _Ref)
+	{
+		const bool IsPointer = GetVar(_Ref).PointerIndirection > 0;
+		const bool IsMemory = IsEscaping(_Ref) || IsPointer;
+		Drop([&](const ValueExpr& _Value)
+		{
+			return DependsOn(_Value, _Ref) || (IsMemory && _Value.IsIndirect) || (IsPointer && DependsOnEscaping(_Value));
+		});
+	};
+
+	auto DropCall = [&]()
+	{
+		Drop([&](const ValueExpr& _Value) { return _Value.IsIndirect || DependsOnEscaping(_Value); });
+	};
+
+	std::vector<bool> IsEntered(_Func.Loops.size(), false);
+	for (const auto& Event : Events)
+	{
+		// The loop runs again after its end : whatever it changes is not available at its start.
+		for (size_t l = 0; l < _Func.Loops.size(); l++)
+		{
+			const CodeRange& Loop = _Func.Loops[l];
+			if (IsEntered[l] || Event.At <= Loop.Begin || Event.At > Loop.End)
+				continue;
+
+			IsEntered[l] = true;
+			for (const auto& Use : _Func.Uses)
+				if (Use.IsStore && Use.Pos >= Loop.Begin && Use.Pos < Loop.End)
+					DropStore(Use.Var);
+			if (std::any_of(_Func.Calls.begin(), _Func.Calls.end(), [&Loop](const CallRef& _Call) { return _Call.Pos >= Loop.Begin && _Call.Pos < Loop.End; }))
+				DropCall();
+		}
+
+		switch (Event.Kind)
+		{
+		case EventKind::Label:
+			Available.clear();
+			break;
+
+		case EventKind::Value:
+		{
+			const auto Found = Available.emplace(_Func.Values[Event.Index].Key, int(Event.Index));
+			if (!Found.second)
+				_Func.Reuses.push_back({ int(Event.Index), Found.first->second });
+			break;
+		}
+
+		case EventKind::Store:
+			DropStore(_Func.Uses[Event.Index].Var);
+			break;
+
+		case EventKind::Call:
+			DropCall();
+			break;
+
+		case EventKind::ConditionalEnd:
+		{
+			const CodeRange& Range = _Func.Conditionals[Event.Index];
+			Drop([&Range](const ValueExpr& _Value) { return _Value.Pos >= Range.Begin && _Value.Pos < Range.End; });
+			break;
+		}
+		}
+	}
+}
+
+// Few cases are compared one by one. Past that, a jump table is used when at least 40% of its entries are
+// cases, and a balanced compare tree otherwise : O(1) or O(log n) compares instead of O(n).
+void Compiler::LowerSwitches(Function& _Func)
+{
+	constexpr int MaxLinearCases = 3;
+	constexpr long long MinTableDensity = 40;
+	constexpr long long MaxTableSize = 1024;
+
+	for (auto& Cur : _Func.Switches)
+	{
+		std::vector<int> Values;
+		for (const auto& Case : Cur.Cases)
+			Values.push_back(Case.Value);
+		std::sort(Values.begin(), Values.end());
+		Values.erase(std::unique(Values.begin(), Values.end()), Values.end());
+
+		const long long NbCases = (long long)Values.size();
+		const long long Range = Values.empty() ? 0 : (long long)Values.back() - Values.front() + 1;
+		Cur.TableSize = 0;
+
+		if (NbCases <= MaxLinearCases)
+		{
+			Cur.Lowering = SwitchLowering::Linear;
+			Cur.NbCompares = int(NbCases);
+		}
+		else if (Range <= MaxTableSize && NbCases * 100 >= Range * MinTableDensity)
+		{
+			Cur.Lowering = SwitchLowering::JumpTable;
+			Cur.NbCompares = 1;
+			Cur.TableSize = int(Range);
+		}
+		else
+		{
+			Cur.Lowering = SwitchLowering::BinaryTree;
+			Cur.NbCompares = 0;
+			for (long long n = NbCases; n > 0; n /= 2)
+				Cur.NbCompares++;
+		}
+	}
+}
+
+// Fields are placed in _Order, each on its alignment. A struct is as aligned as its widest field, and its
+// size is rounded up to that alignment so that the elements of an array stay aligned.
+void Compiler::LayoutStruct(StructType& _Struct, const std::vector<int>& _Order)
+{
+	int Offset = 0;
+	_Struct.Align = 1;
+	for (const int i : _Order)
+	{
+		Variable& Field = _Struct.Fields[i];
+		const int Align = VarAlign(Field);
+		Offset = (Offset + Align - 1) / Align * Align;
+		Field.Offset = Offset;
+		Offset += VarSize(Field);
+		_Struct.Align = std::max(_Struct.Align, Align);
+	}
+
+	_Struct.Layout = _Order;
+	_Struct.Size = (Offset + _Struct.Align - 1) / _Struct.Align * _Struct.Align;
+}
+
+// A member reached through literal indices sits at a constant offset from its variable : it is addressed
+// as the variable plus that offset, the same way as a variable on its own.
+void Compiler::FoldOffsets(Function& _Func)
+{
+	for (auto& Use : _Func.Uses)
+	{
+		Use.Offset = -1;
+		if (std::none_of(Use.Steps.begin(), Use.Steps.end(), [](const AccessStep& _Step) { return _Step.Struct >= 0; }))
+			continue;
+
+		const Variable* Cur = &GetVar(Use.Var);
+		size_t NbIndices = 0;
+		int Offset = 0;
+		bool IsConstant = true;
+		for (const auto& Step : Use.Steps)
+		{
+			if (Step.Struct >= 0)
+			{
+				Cur = &Structs[Step.Struct].Fields[Step.Field];
+				Offset += Cur->Offset;
+				NbIndices = 0;
+			}
+			else if (!Step.Index.has_value() || NbIndices >= Cur->ArraySizes.size())
+			{
+				// A computed index, or an index through a pointer : the address is not the variable's.
+				IsConstant = false;
+				break;
+			}
+			else
+			{
+				int Stride = ElemSize(*Cur);
+				for (size_t d = NbIndices + 1; d < Cur->ArraySizes.size(); d++)
+					Stride *= Cur->ArraySizes[d];
+				Offset += *Step.Index * Stride;
+				NbIndices++;
+			}
+		}
+
+		if (IsConstant)
+			Use.Offset = Offset;
+	}
+}
+
+// Only touches the records of _Func, and reads the signatures of the others.
+void Compiler::OptimizeFunction(Function& _Func, Peephole& _Peephole)
+{
+	FoldOffsets(_Func);
+	ResolveTailCalls(_Func);
+	NumberValues(_Func);
+	LowerSwitches(_Func);
+	LayoutFrame(_Func);
+	_Peephole.Run(_Func.Code);
+}
+
+// Profiles are written by the simulator, one record per line, '#' starting a comment :
+//	global <name> <accesses>
+//	block <label> <executions>
+//	call <function> <calls>
+//	edge <from label> <to label> <executions>
+// A function's block count also counts the loops jumping back to its label, so calls are counted apart.
+// Block and edge counts are meant for block layout, which needs the code generator : they are not read yet.
+bool Compiler::LoadProfile(const char* _Filename)
+{
+	std::ifstream File(_Filename);
+	if (!File)
+		return false;
+
+	std::string Line;
+	while (std::getline(File, Line))
+	{
+		std::istringstream Fields(Line.substr(0, Line.find('#')));
+		std::string Kind, Identifier;
+		long long Count = 0;
+		if (!(Fields >> Kind >> Identifier >> Count))
+			continue;
+
+		if (Kind == "global")
+			GlobalProfile[Identifier] = Count;
+		else if (Kind == "call")
+			CallProfile[Identifier] = Count;
+	}
+
+	HasProfile = true;
+	return true;
+}
+
+// Each reference weighs 8 per loop around it, times the number of calls of its function when profiled,
+// as a guess of how often it runs : a function the profiled run never called weighs nothing. Profiled access counts replace the guess for the globals the profile
+// lists. The globals saving the most accesses per byte get the short-address window.
+long long Compiler::UseWeight(const Function& _Func, size_t _Pos) const
+{
+	constexpr long long LoopWeight = 8;
+
+	const auto Calls = CallProfile.find(_Func.Identifier);
+	long long Weight = Calls != CallProfile.end() ? Calls->second : HasProfile ? 0 : 1;
+	for (const auto& Loop : _Func.Loops)
+		if (_Pos >= Loop.Begin && _Pos < Loop.End)
+			Weight *= LoopWeight;
+
+	return Weight;
+}
+
+void Compiler::PlaceHotGlobals()
+{
+	for (auto& Var : GlobalVars)
+	{
+		Var.AccessWeight = 0;
+		Var.IsShort = false;
+	}
+
+	for (const auto& Func : Functions)
+	{
+		if (!Func.IsLive)
+			continue;
+
+		for (const auto& Use : Func.Uses)
+		{
+			if (Use.Var.Function >= 0 || IsDeadCode(Func, Use.Pos))
+				continue;
+
+			GetVar(Use.Var).AccessWeight += UseWeight(Func, Use.Pos);
+		}
+	}
+
+	std::vector<int> Candidates;
+	for (int i = 0; i < int(GlobalVars.size()); i++)
+	{
+		Variable& Var = GlobalVars[i];
+		const auto Profiled = GlobalProfile.find(Var.Identifier);
+		if (Profiled != GlobalProfile.end())
+			Var.AccessWeight = Profiled->second;
+
+		if (!Var.IsUnused && Var.AccessWeight > 0 && VarSize(Var) > 0)
+			Candidates.push_back(i);
+	}
+
+	std::stable_sort(Candidates.begin(), Candidates.end(), [this](int _A, int _B)
+	{
+		const Variable& A = GlobalVars[_A];
+		const Variable& B = GlobalVars[_B];
+		return IsDenser(A.AccessWeight, VarSize(A), B.AccessWeight, VarSize(B));
+	});
+
+	// Only candidates : the linker shares the window between all the objects.
+	int Size = int(ShortWindowStart);
+	for (const int i : Candidates)
+	{
+		Variable& Var = GlobalVars[i];
+		const int Align = VarAlign(Var);
+		const int End = (Size + Align - 1) / Align * Align + VarSize(Var);
+		if (End > int(ShortAddressWindow))
+			continue;
+
+		Var.IsShort = true;
+		Size = End;
+	}
+}
+
+// Zero-initialized globals go to .bss, which the loader zeroes and takes no room in the image.
+static bool IsBssVar(const Variable& _Var)
+{
+	return _Var.StaticInit.value_or(0) == 0;
+}
+
+// Globals are sorted by decreasing alignment, then decreasing size, so that no padding is needed
+// between them. Offsets are relative to the start of their section.
+void Compiler::LayoutGlobals()
+{
+	GlobalOrder.clear();
+	DeclOrderSize = 0;
+	for (int i = 0; i < int(GlobalVars.size()); i++)
+	{
+		const Variable& Var = GlobalVars[i];
+		if (Var.IsUnused)
+			continue;
+
+		const int Align = VarAlign(Var);
+		DeclOrderSize = (DeclOrderSize + Align - 1) / Align * Align + VarSize(Var);
+		GlobalOrder.push_back(i);
+	}
+
+	std::stable_sort(GlobalOrder.begin(), GlobalOrder.end(), [this](int _A, int _B)
+	{
+		const Variable& A = GlobalVars[_A];
+		const Variable& B = GlobalVars[_B];
+		if (A.IsShort != B.IsShort)
+			return A.IsShort;
+		if (!A.IsShort && IsBssVar(A) != IsBssVar(B))
+			return !IsBssVar(A);
+		if (VarAlign(A) != VarAlign(B))
+			return VarAlign(A) > VarAlign(B);
+		return VarSize(A) > VarSize(B);
+	});
+
+	ShortSize = 0;
+	DataSize = 0;
+	BssSize = 0;
+	for (const int i : GlobalOrder)
+	{
+		Variable& Var = GlobalVars[i];
+		int& Size = Var.IsShort ? ShortSize : IsBssVar(Var) ? BssSize : DataSize;
+		const int Align = VarAlign(Var);
+		Size = (Size + Align - 1) / Align * Align;
+		Var.Offset = Size;
+		Size += VarSize(Var);
+	}
+}
+
+// Whole-program passes run first, then the functions are processed in parallel. Each worker keeps its own
+// peephole statistics, added up afterwards : the output is the same whatever the number of threads.
+void Compiler::Optimize()
+{
+	EliminateDeadCode();
+	NarrowRanges();
+
+	std::vector<Peephole> Workers(NbThreads);
+	ParallelFor(Functions.size(), NbThreads, [this, &Workers](size_t _Index, int _Worker)
+	{
+		OptimizeFunction(Functions[_Index], Workers[_Worker]);
+	});
+
+	for (const auto& Worker : Workers)
+		PeepholeOpt.Merge(Worker);
+
+	PlaceHotGlobals();
+	LayoutGlobals();
+}
+
+// Every function and every global gets its own section, so that the linker can drop the unused ones.
+void Compiler::EmitObject(Object& _Obj)
+{
+	std::vector<int> FuncSections(Functions.size(), -1);
+	for (size_t f = 0; f < Functions.size(); f++)
+	{
+		const Function& Func = Functions[f];
+		if (!Func.IsLive || !Func.IsDefined)
+			continue;
+
+		// Func.Code gets encoded here once the backend emits it : for now every function is empty.
+		FuncSections[f] = _Obj.AddSection(".text." + Func.Identifier, 2, false);
+
+		ObjSymbol& Symbol = _Obj.Symbols[_Obj.AddSymbol(Func.Identifier)];
+		Symbol.Section = FuncSections[f];
+		Symbol.Size = _Obj.Sections[FuncSections[f]].Size();
+		Symbol.IsFunction = true;
+		Symbol.IsLocal = Func.IsStatic;
+	}
+
+	for (const int i : GlobalOrder)
+	{
+		const Variable& Var = GlobalVars[i];
+
+		// Only non-zero initial values need to be stored, the loader zeroes the rest.
+		// The short-address window is part of the image, so it always holds its initial values.
+		const bool IsZero = !Var.IsShort && IsBssVar(Var);
+		const char* Prefix = Var.IsShort ? ".short." : IsZero ? ".bss." : ".data.";
+		const int SectionIndex = _Obj.AddSection(Prefix + Var.Identifier, VarAlign(Var), IsZero);
+		ObjSection& Section = _Obj.Sections[SectionIndex];
+		Section.AccessWeight = Var.IsShort ? Var.AccessWeight : 0;
+
+		const int Size = VarSize(Var);
+		if (IsZero)
+		{
+			Section.BssSize = Size;
+		}
+		else
+		{
+			if (Var.StaticInit.has_value())
+				EncodeValue(Section.Data, Var.StaticInit.value(), ElemSize(Var));
+			Section.Data.resize(Size, 0);
+		}
+
+		ObjSymbol& Symbol = _Obj.Symbols[_Obj.AddSymbol(Var.Identifier)];
+		Symbol.Section = SectionIndex;
+		Symbol.Size = Size;
+		Symbol.IsLocal = Var.IsStatic;
+	}
+
+	// Until the code is encoded, references from a function are recorded at its start.
+	for (size_t f = 0; f < Functions.size(); f++)
+	{
+		const Function& Func = Functions[f];
+		if (FuncSections[f] < 0)
+			continue;
+
+		std::vector<int> Referenced;
+		auto Reference = [&](const std::string& _Name)
+		{
+			const int Symbol = _Obj.AddSymbol(_Name);
+			if (std::find(Referenced.begin(), Referenced.end(), Symbol) == Referenced.end())
+			{
+				Referenced.push_back(Symbol);
+				_Obj.AddRelocation(FuncSections[f], 0, Symbol, RelocType::None);
+			}
+		};
+
+		for (const auto& Call : Func.Calls)
+			if (!IsDeadCode(Func, Call.Pos))
+				Reference(Call.Callee);
+
+		for (const auto& Use : Func.Uses)
+			if (Use.Var.Function < 0 && !IsDeadCode(Func, Use.Pos) && !GetVar(Use.Var).IsUnused)
+				Reference(GetVar(Use.Var).Identifier);
+	}
+}
+
+void Compiler::WriteListing(std::ostream& _Out, const Object& _Obj)
+{
+	_Out << "; DevonC listing\n";
+	for (const auto& Func : Functions)
+	{
+		if (!Func.IsLive || !Func.IsDefined)
+			continue;
+
+		_Out << "\n" << Func.Identifier << ":\n";
+		for (const auto& Instr : Func.Code)
+		{
+			if (Instr.Class == OpClass::Label)
+				_Out << Instr.Dst << ":\n";
+			else
+				_Out << "\t" << Instr.Opcode << (Instr.Dst.empty() ? "" : " " + Instr.Dst) << (Instr.Src.empty() ? "" : ", " + Instr.Src) << "\n";
+		}
+	}
+
+	_Obj.WriteListing(_Out);
+}
+
+std::string Compiler::TypeName(const Variable& _Var) const
+{
+	std::string Name;
+	switch (_Var.Type)
+	{
+	case VarType::Void:		Name = "Void";	break;
+	case VarType::Char:		Name = "Char";	break;
+	case VarType::Bool:		Name = "Bool";	break;
+	case VarType::Short:	Name = "Short";	break;
+	case VarType::Int:		Name = "Int";	break;
+	case VarType::Struct:	Name = "Struct " + Structs[_Var.Struct].Identifier;	break;
+	default:				Name = "Unknown-Type";	break;
+	}
+
+	return Name + std::string(_Var.PointerIndirection, '*');
+}
+
+void Compiler::DumpDebug()
+{
+	if (!Structs.empty())
+		std::cout << "\nStructs:\n";
+	for (const auto& Struct : Structs)
+	{
+		std::cout << "\t" << Struct.Identifier << " : " << Struct.Size << " bytes";
+		if (Struct.IsReordered)
+			std::cout << ", reordered from " << Struct.DeclOrderSize << " bytes";
+		std::cout << "\n";
+
+		for (const int i : Struct.Layout)
+		{
+			const Variable& Field = Struct.Fields[i];
+			std::cout << "\t\t[+" << Field.Offset << "] " << TypeName(Field) << " " << Field.Identifier;
+			for (auto ArraySize : Field.ArraySizes)
+				std::cout << "[" << ArraySize << "]";
+			std::cout << "\n";
+		}
+	}
+
+	std::cout << "\nGlobals:\n";
+	for (auto var : GlobalVars)
+	{
+		std::cout << "\t" << TypeName(var);
+		std::cout << " " << var.Identifier;
+		if (!var.IsUnused)
+			std::cout << " [" << (var.IsShort ? ".short" : IsBssVar(var) ? ".bss" : ".data") << "+" << var.Offset << "] x" << var.AccessWeight;
+		if (var.IsNarrowed)
+			std::cout << " (16-bit)";
+		if (var.IsUnused)
+			std::cout << " (unused)";
+
+		for (auto arraySize : var.ArraySizes)
+			std::cout << "[" << arraySize << "]";
+
+		if (var.StaticInit.has_value())
+			std::cout << " = " << var.StaticInit.value() << "\n";
+
+		std::cout << "\n";
+	}
+
+	// Each section starts on a word boundary.
+	const int PackedSize = ((ShortSize + 1) & ~1) + ((DataSize + 1) & ~1) + BssSize;
+	std::cout << "\t.short " << ShortSize << " bytes, .data " << DataSize << " bytes, .bss " << BssSize << " bytes : " << DeclOrderSize - PackedSize
+		<< " bytes saved over declaration order (" << DeclOrderSize << " bytes)\n";
+
+	std::cout << "\nFunctions:\n";
+	for (const auto& Func : Functions)
+	{
+		std::cout << "\t" << Func.Identifier << "(" << Func.Params.size() << " param" << (Func.Params.size() > 1 ? "s" : "") << ")";
+		if (!Func.IsDefined)
+			std::cout << " : declared only";
+		else if (!Func.IsLive)
+			std::cout << " : unused";
+		else
+			std::cout << " : frame " << Func.NaiveFrameSize << " -> " << Func.FrameSize << " bytes";
+		if (Func.IsLive && HasProfile)
+			std::cout << ", " << (CallProfile.count(Func.Identifier) > 0 ? CallProfile.at(Func.Identifier) : 0) << " profiled calls";
+		std::cout << "\n";
+
+		if (!Func.IsLive)
+			continue;
+
+		int NbDeadStores = 0;
+		for (const auto& Use : Func.Uses)
+			if (Use.IsStore && Use.Var.Function >= 0 && Use.Var.Scope >= 0 && GetVar(Use.Var).IsUnused && !IsDeadCode(Func, Use.Pos))
+				NbDeadStores++;
+		if (NbDeadStores > 0)
+			std::cout << "\t\t" << NbDeadStores << " dead store" << (NbDeadStores > 1 ? "s" : "") << "\n";
+
+		for (const auto& Range : Func.DeadCode)
+			std::cout << "\t\tLine " << Range.Line << " : unreachable\n";
+
+		for (const auto& Scope : Func.Scopes)
+			for (const auto& Var : Scope.Variables)
+				if (Var.IsUnused)
+					std::cout << "\t\t" << Var.Identifier << " (unused)\n";
+				else
+					std::cout << "\t\t[+" << Var.Offset << "] " << Var.Identifier << (Var.IsNarrowed ? " (16-bit)" : "") << "\n";
+
+		for (const auto& Use : Func.Uses)
+		{
+			if (Use.Offset < 0 || IsDeadCode(Func, Use.Pos))
+				continue;
+
+			const Variable& Var = GetVar(Use.Var);
+			std::cout << "\t\tLine " << Use.Line << " : " << Var.Identifier;
+			for (const auto& Step : Use.Steps)
+				if (Step.Struct >= 0)
+					std::cout << "." << Structs[Step.Struct].Fields[Step.Field].Identifier;
+				else
+					std::cout << "[" << *Step.Index << "]";
+			std::cout << " at " << Var.Identifier << "+" << Use.Offset << "\n";
+		}
+
+		for (const auto& Call : Func.TailCalls)
+			std::cout << "\t\tLine " << Call.Line << " : return " << Call.Callee << "(...) " << (Call.IsJump ? "-> jump" : "-> call") << "\n";
+
+		for (const auto& Cur : Func.Switches)
+		{
+			std::cout << "\t\tLine " << Cur.Line << " : switch, " << Cur.Cases.size() << " case" << (Cur.Cases.size() > 1 ? "s" : "") << " -> ";
+			switch (Cur.Lowering)
+			{
+			case SwitchLowering::Linear:		std::cout << "linear";	break;
+			case SwitchLowering::BinaryTree:	std::cout << "binary tree";	break;
+			case SwitchLowering::JumpTable:		std::cout << "jump table of " << Cur.TableSize << " entries (" << Cur.TableSize * TypeSize(VarType::Pointer) << " bytes)";	break;
+			}
+			std::cout << ", " << Cur.NbCompares << " compare" << (Cur.NbCompares > 1 ? "s" : "") << " at most\n";
+		}
+
+		// Parts of a larger value reused are reused along with it : only the larger one is listed.
+		static const char* ValueKindNames[] = { "address", "load", "value" };
+		auto Covers = [&Func](const ValueReuse& _A, const ValueReuse& _B)
+		{
+			const ValueExpr& A = Func.Values[_A.Value];
+			const ValueExpr& B = Func.Values[_B.Value];
+			if (A.Pos > B.Pos || A.End < B.End)
+				return false;
+			return A.End - A.Pos != B.End - B.Pos || A.Kind > B.Kind;
+		};
+
+		for (const auto& Reuse : Func.Reuses)
+		{
+			if (std::any_of(Func.Reuses.begin(), Func.Reuses.end(), [&](const ValueReuse& _Other) { return Covers(_Other, Reuse); }))
+				continue;
+
+			const ValueExpr& Value = Func.Values[Reuse.Value];
+			std::cout << "\t\tLine " << Value.Line << " : " << Value.Text << " reuses the " << ValueKindNames[int(Value.Kind)]
+				<< " of line " << Func.Values[Reuse.First].Line << "\n";
+		}
+	}
+
+	PeepholeOpt.DumpStats();
+}
+
@@ -1,14 +1,34 @@
 #pragma once
 
 #include <stack>
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <optional>
+#include <unordered_map>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 #include <iostream>
 
 #include "../PEGTL-master/include/tao/pegtl.hpp"
 
-#define DLOG printf
+#include "Devon16.h"
+#include "Peephole.h"
+#include "Object.h"
+#include "Parallel.h"
+#include "IncludeSearch.h"
+#include "Preprocessor.h"
+
+namespace DevonC
+{
+	// Parse traces, on by default : the self-checks turn them off around the samples they compile.
+	int DebugLog(const char* _Format, ...);
+	void SetDebugLog(bool _IsOn);
+}
+
+#define DLOG DevonC::DebugLog
 
 namespace DevonC
 {
@@ -29,21 +49,43 @@ namespace DevonC
 		Void,
 		Bool,
 		Pointer,
+		Struct,
 	};
 
 	struct Variable
 	{
 		std::string Identifier;
 		VarType Type = VarType::Unknown;
+		int Struct = -1;			// Index in the struct definitions, when Type is Struct.
 		std::vector<int> ArraySizes;
 		int PointerIndirection = 0;
 		std::optional<int> StaticInit;
+		int Offset = -1;			// Frame offset for locals, offset in the struct for members.
+		bool IsAddressTaken = false;
+		bool IsNarrowed = false;	// Int proven to fit in 16 bits : stored and operated on as a Short.
+		bool IsUnused = false;		// Never read by live code : no storage, its stores are dead.
+		bool IsShort = false;		// Global placed in the short-address window.
+		bool IsStatic = false;		// Global only visible in its translation unit.
+		long long AccessWeight = 0;	// Global references weighted by loop depth, or profiled accesses.
 
 		Variable() {};
 		Variable(const std::string& _Identifier) : Identifier(_Identifier) {};
 		Variable(const std::string&& _Identifier) : Identifier(_Identifier) {};
 	};
 
+	struct StructType
+	{
+		std::string Identifier;
+		std::vector<Variable> Fields;	// In declaration order.
+		std::vector<int> Layout;		// Fields by increasing offset.
+		int Size = 0;
+		int Align = 1;
+		int DeclOrderSize = 0;
+		bool IsReordered = false;		// Declared [[reorder]] : the compiler picks the field order.
+		bool IsComplete = false;		// Its closing brace was met.
+		size_t Line = 0;
+	};
+
 	enum class CodeBlockType : unsigned char
 	{
 		Unknown,
@@ -64,15 +106,171 @@ namespace DevonC
 	{
 		std::vector<Variable>			Variables;
 		std::vector<CodeBlockHandler>	CodeBlocks;
+		int Parent = -1;
+		bool IsTerminated = false;		// A return, break or goto was met : what follows is unreachable until a label.
 
 		//	std::string Name;
 	};
 
+	struct VarRef
+	{
+		int Function = -1;			// -1 : global.
+		int Scope = -1;				// -1 in a function : parameter.
+		int Index = -1;
+	};
+
+	enum class RangeDefKind : unsigned char
+	{
+		Unknown,
+		Constant,					// v = Value
+		Step,						// v = v + Step, in a for loop guarded by v < Value + 1 (v > Value - 1 when Step < 0)
+	};
+
+	struct RangeDef
+	{
+		VarRef Var;
+		RangeDefKind Kind = RangeDefKind::Unknown;
+		int Value = 0;
+		int Step = 0;
+		int InFunction = -1;
+		size_t Pos = 0;
+	};
+
+	// One index or member after the variable in an access chain.
+	struct AccessStep
+	{
+		int Struct = -1;			// -1 : an index.
+		int Field = -1;
+		std::optional<int> Index;	// Set when the index is a literal.
+	};
+
+	// Positions are byte offsets in the preprocessed source of the file the function is in.
+	struct VarUse
+	{
+		VarRef Var;
+		size_t Pos = 0;
+		size_t End = 0;				// Where the access is complete, for a store where the assignment is.
+		size_t Line = 0;
+		bool IsStore = false;
+		std::vector<AccessStep> Steps;
+		int Offset = -1;			// From the start of the variable, when the steps reach a member through literal indices only.
+	};
+
+	struct CallRef
+	{
+		std::string Callee;
+		size_t Pos = 0;
+		size_t End = 0;
+	};
+
+	enum class ValueKind : unsigned char
+	{
+		Address,					// Address of an element or member, from indices that are not all constant.
+		Load,						// Value read through an access chain.
+		Expression,					// Arithmetic on variables.
+	};
+
+	// A computation the value numbering looks for again further in the function.
+	struct ValueExpr
+	{
+		ValueKind Kind = ValueKind::Expression;
+		std::string Key;			// Variables resolved, literals in decimal : equal keys compute the same value.
+		std::string Text;			// As written.
+		std::vector<VarRef> Deps;	// Variables whose value, or memory, it reads.
+		bool IsIndirect = false;	// Reads memory through a pointer : any store to memory may change it.
+		size_t Pos = 0;
+		size_t End = 0;
+		size_t Line = 0;
+	};
+
+	struct ValueReuse
+	{
+		int Value = -1;				// Indices in Function::Values.
+		int First = -1;
+	};
+
+	struct CodeRange
+	{
+		size_t Begin = 0;
+		size_t End = 0;
+		size_t Line = 0;
+	};
+
+	struct ConstBranch
+	{
+		int Value = 0;
+		CodeRange Then;
+		CodeRange Else;
+		bool HasElse = false;
+	};
+
+	struct LoopCounter
+	{
+		std::string Identifier;
+		bool IsSameVar = true;
+		bool IsDecrement = false;
+		int Step = 0;
+		int Bound = 0;
+		int BoundAdjust = 0;		// Turns the loop condition into an inclusive bound.
+		bool IsValid = false;
+	};
+
+	struct TailCall
+	{
+		std::string Callee;
+		int NbArgs = 0;
+		size_t Line = 0;
+		bool IsJump = false;		// Set by ResolveTailCalls() when the call can reuse the caller's argument slots.
+	};
+
+	enum class SwitchLowering : unsigned char
+	{
+		Linear,						// One compare per case.
+		BinaryTree,					// Balanced compares over the sorted cases.
+		JumpTable,					// One bounds check, then a jump through a table in .rodata.
+	};
+
+	struct SwitchCase
+	{
+		int Value = 0;
+		size_t Line = 0;
+	};
+
+	struct Switch
+	{
+		std::vector<SwitchCase> Cases;
+		bool HasDefault = false;
+		size_t Line = 0;
+		SwitchLowering Lowering = SwitchLowering::Linear;
+		int NbCompares = 0;			// On the longest path to a case.
+		int TableSize = 0;			// Entries of the jump table, from the lowest case to the highest.
+	};
+
 	struct Function
 	{
-		Scope Scope;
+		std::vector<Scope> Scopes;		// Scopes[0] is the function body, nested scopes follow in opening order.
 
 		std::string Identifier;
+		Variable ReturnType;
+		std::vector<Variable> Params;
+		std::vector<TailCall> TailCalls;
+		InstructionList Code;			// Emitted by the backend.
+		std::vector<VarUse> Uses;
+		std::vector<CallRef> Calls;
+		std::vector<CodeRange> DeadCode;
+		std::vector<CodeRange> Loops;
+		std::vector<CodeRange> Conditionals;	// Code that may not run : branches of an if, operands of && and ||, loop steps.
+		std::vector<size_t> Labels;
+		std::vector<ValueExpr> Values;
+		std::vector<ValueReuse> Reuses;
+		std::vector<Switch> Switches;
+		bool IsDefined = false;
+		bool IsStatic = false;
+		bool IsLive = true;
+		bool HasLabels = false;
+		int NaiveFrameSize = 0;
+		int FrameSize = 0;
+
 		Function(const std::string& _Identifier) : Identifier(_Identifier) {};
 	};
 
@@ -81,30 +279,146 @@ namespace DevonC
 		VoidVarDecl,
 		BadInitializerLiteralType,
 		IncludeFileFail,
+		FuncSignatureMismatch,
+		DuplicateCase,
+		DuplicateDefault,
+		UnknownStruct,
+		DuplicateStruct,
+		IncompleteStruct,
+		DuplicateMember,
+		UnknownMember,
 	};
 
 	class Compiler
 	{
 		std::stack<std::string>	IncludeStack;
 		std::vector<Variable>	GlobalVars;
+		std::vector<StructType>	Structs;
 		std::vector<Function>	Functions;
-		std::vector<Scope>		ScopeStack;
+		std::vector<int>		ScopeStack;
 		std::vector<Variable>	PendingVarDecls;
+		std::vector<Variable>	PendingParams;
+		std::vector<RangeDef>	RangeDefs;
+		std::vector<int>		SwitchStack;		// Switches being parsed, in Functions[CurFunction].Switches.
+		int CurFunction = -1;
 		int NbErrors = 0;
-
-		int TypeSize(VarType _Type);
+		Peephole PeepholeOpt;
+		std::unordered_map<std::string, long long> GlobalProfile;
+		std::unordered_map<std::string, long long> CallProfile;
+		bool HasProfile = false;
+		std::vector<int> GlobalOrder;		// Globals as laid out, .short first, then .data and .bss.
+		int ShortSize = 0;
+		int DataSize = 0;
+		int BssSize = 0;
+		int DeclOrderSize = 0;				// Storage needed with the globals in declaration order.
+		int NbThreads = 1;
+		std::unordered_map<std::string, std::shared_future<std::string>> Prefetched;	// Sources without comments, by filename.
+		std::deque<std::pair<std::string, std::promise<std::string>>> PrefetchQueue;	// Files no prefetch thread has taken yet.
+		std::vector<std::thread> PrefetchThreads;	// Up to NbThreads, started as files get queued.
+		int NbPrefetching = 0;						// Files being read by a prefetch thread.
+		bool StopPrefetch = false;
+		std::mutex PrefetchMutex;
+		std::condition_variable PrefetchReady;		// A file was queued, or the threads are to stop.
+		std::condition_variable PrefetchDone;		// A prefetch thread finished a file.
+		IncludeSearch Includes;
+		Preprocessor Macros;
+		std::deque<PreprocessedFile> PreprocessedFiles;		// Macro-expanded, in the order the parser includes them.
+
+		int TypeSize(VarType _Type, int _Struct = -1);
+		int ElemSize(const Variable& _Var);
+		int VarSize(const Variable& _Var);
+		int VarAlign(const Variable& _Var);
+		int ArgSlotsSize(const Function& _Func);
+		Function* FindFunction(const std::string& _Identifier);
+		bool FindVar(const std::string& _Identifier, VarRef& _Ref);
+		Variable& GetVar(const VarRef& _Ref);
+		bool IsDeadCode(const Function& _Func, size_t _Pos) const;
+		long long UseWeight(const Function& _Func, size_t _Pos) const;
+		std::string TypeName(const Variable& _Var) const;
+		void ResolveAccess(const std::string& _Access, VarUse& _Use);
+		void LayoutStruct(StructType& _Struct, const std::vector<int>& _Order);
+		void FoldOffsets(Function& _Func);
+		void EliminateDeadCode();
+		void ResolveTailCalls(Function& _Func);
+		void NarrowRange(Variable& _Var, const VarRef& _Ref);
+		void NarrowRanges();
+		int LayoutScope(Function& _Func, int _ScopeIndex, int _Base);
+		void LayoutFrame(Function& _Func);
+		std::string ValueKey(const std::string& _Text, std::vector<VarRef>& _Deps, bool& _IsIndirect);
+		void PushValue(ValueKind _Kind, const std::string& _Text, size_t _Pos, size_t _Line);
+		bool IsEscaping(const VarRef& _Ref);
+		void NumberValues(Function& _Func);
+		void LowerSwitches(Function& _Func);
+		void OptimizeFunction(Function& _Func, Peephole& _Peephole);
+		std::shared_future<std::string> Prefetch(const std::string& _Filename);
+		void PrefetchIncludes(const std::string& _Source, const std::string& _Filename);
+		void PrefetchWorker();
+		void WaitPrefetches();
+		void PreprocessorError(const std::string& _Path, size_t _Line, const std::string& _Message);
+		std::string TakePreprocessed(const std::string& _Filename);
+		void PlaceHotGlobals();
+		void LayoutGlobals();
 
 	public:
 		std::string				LastFilename;
+		bool IsAngleInclude = false;
+		std::string				LastFuncId;
+		int LastCaseValue = 0;
+		std::string				LastStructId;
+		std::string				LastMemberId;
+		bool PendingReorder = false;
+		bool PendingStatic = false;
+		std::string				LastForCond;
+		bool PendingAddressOf = false;
+		std::vector<bool> SuspendedAddressOf;	// PendingAddressOf of the enclosing accesses, while their indices parse.
 		Variable CurVarDecl;
+		Variable CurFuncDecl;
 		int CurLiteralValue = 0;
 		LiteralType CurLiteralType = LiteralType::None;
 
+		~Compiler() { WaitPrefetches(); }
+
 		bool Compile(const char* _Filename);
+		bool LoadProfile(const char* _Filename);
+		bool DefineMacro(const std::string& _Definition) { return Macros.Define(_Definition); }
+		void AddIncludePath(const std::string& _Dir, bool _IsSystem) { Includes.AddPath(_Dir, _IsSystem); }
+		std::string FindInclude(const std::string& _Filename, bool _IsAngle);
+		void SetNbThreads(int _NbThreads) { NbThreads = std::max(1, _NbThreads); }
 		void ErrorMessage(EErrorCode ErrorCode, size_t line);
 		void SetCurLiteral(LiteralType _Type, int _Value = 0);
 		void PushPendingVarDecl(const size_t line);
+		void SetStructType(const std::string& _Identifier);
+		void ValidateStructType(Variable& _Var, size_t _Line);
+		void BeginStruct(const std::string& _Identifier, size_t _Line);
+		void PushStructFields();
+		void EndStruct();
 		void ValidateGlobalVar();
+		void ValidateLocalVar();
+		void OpenScope();
+		void CloseScope();
+		void BeginFuncDecl();
+		void PushFuncParam(const size_t line);
+		void DeclareFunction(const size_t line);
+		void DefineFunction();
+		void EndFuncDecl();
+		void PushTailCall(TailCall&& _Call);
+		void PushAssignment(const std::string& _Assignment, size_t _Pos);
+		void PushLoopStep(const std::string& _Next);
+		void PushVarAccess(const std::string& _Access, size_t _Pos, size_t _Line);
+		void PushExpression(const std::string& _Expression, size_t _Pos, size_t _Line);
+		void PushCall(const std::string& _Call, size_t _Pos);
+		void PushLabel(size_t _Pos);
+		void PushLoop(const CodeRange& _Loop);
+		void PushConditional(const CodeRange& _Range);
+		void BeginSwitch();
+		void PushCase(int _Value, size_t _Pos, size_t _Line);
+		void PushDefault(size_t _Pos, size_t _Line);
+		void EndSwitch(const CodeRange& _Statement);
+		void PushScopeStatement(const CodeRange& _Statement, bool _IsJump);
+		void PushDeadCode(const CodeRange& _Range);
+		void Optimize();
+		void EmitObject(Object& _Obj);
+		void WriteListing(std::ostream& _Out, const Object& _Obj);
 		int GetNbErrors() const { return NbErrors; }
 		void DumpDebug();
 	};
@@ -153,7 +467,9 @@ namespace DevonC
 	struct sblk : star<sor<blank, eol>> {};
 	struct pblk : plus<sor<blank, eol>> {};
 	struct filename : star<if_then_else<at<sor<one<'"'>, one<'>'>>>, failure, seven>> {};
-	struct directive_include : seq< TAO_PEGTL_STRING("#include"), sblk, sor<one<'"'>, one<'<'>>, filename, sor<one<'"'>, one<'>'>> > {};
+	struct includequote : one<'"'> {};
+	struct includeangle : one<'<'> {};
+	struct directive_include : seq< TAO_PEGTL_STRING("#include"), sblk, sor<includequote, includeangle>, filename, sor<one<'"'>, one<'>'>> > {};
 	struct directive : seq< sblk, sor<directive_include>, until< eol, any > > {};
 	struct Id : seq< alpha, star<alnum> > {};
 
@@ -163,8 +479,10 @@ namespace DevonC
 	struct type_void : TAO_PEGTL_STRING("void") {};
 	struct type_bool : TAO_PEGTL_STRING("bool") {};
 	struct type_base : sor< type_int, type_char, type_short, type_void, type_bool > {};
+	struct structtypeid : identifier {};
+	struct type_struct : seq< TAO_PEGTL_STRING("struct"), pblk, structtypeid > {};
 	struct type_pointer : one<'*'> {};
-	struct typespecifier : seq< type_base, star< sblk, type_pointer> > {};
+	struct typespecifier : seq< sor< type_struct, type_base >, star< sblk, type_pointer> > {};
 
 	struct literalchar : seq< one<'\''>, seven, one<'\''>> {};
 	struct literalhexa : seq< one<'0'>, one<'x'>, must<plus<xdigit>> > {};
@@ -179,14 +497,17 @@ namespace DevonC
 	struct vartype : typespecifier {};
 	struct vardecl : seq< vardeclid, star< sblk, one<'['>, sblk, staticarraysize, sblk, one<']'> >, opt<varinit> > {};
 	struct compvardecl : seq<sblk, vartype, pblk, list< vardecl, seq< sblk, one<','>, sblk > > > {};
-	struct globalvardecl : seq< compvardecl, one<';'> > {};
+	struct staticspecifier : TAO_PEGTL_STRING("static") {};
+	struct storageclass : opt< staticspecifier, pblk > {};
+	struct globalvardecl : seq< sblk, storageclass, compvardecl, one<';'> > {};
 	struct localvardecl : seq< compvardecl, one<';'> > {};
 	struct forvardecl : compvardecl {};
 
 	struct memberid : identifier {};
 	struct varid : identifier {};
 	struct arrayindex;
-	struct arrayaccess : seq< one<'['>, sblk, arrayindex, sblk, one<']'> > {};
+	struct arrayindexstart : success {};
+	struct arrayaccess : seq< one<'['>, arrayindexstart, sblk, arrayindex, sblk, one<']'> > {};
 	struct varaccess : seq<varid, star<sblk, arrayaccess>, star< sblk, one<'.'>, sblk, memberid, star<sblk, arrayaccess> >> {};
 	struct lvalue : varaccess {};
 
@@ -265,24 +586,48 @@ namespace DevonC
 	struct breakstatement : seq<TAO_PEGTL_STRING("break"), sblk, one<';'> > {};
 	struct whilestatement : seq<TAO_PEGTL_STRING("while"), must< sblk, one<'('>, sblk, plus< whilecond, sblk>, one<')'>, sblk, statement > > {};
 	struct nextstatement : expression {};
-	struct forstatement : seq<TAO_PEGTL_STRING("for"), must< sblk, one<'('>, sblk, sor< forvardecl, expression >, sblk, one<';'>, sblk, forcond, sblk, one<';'>, sblk, nextstatement, sblk, one<')'>, sblk, statement > > {};
+	struct forscopestart : success {};
+	struct forstatement : seq<TAO_PEGTL_STRING("for"), must< sblk, one<'('>, forscopestart, sblk, sor< forvardecl, expression >, sblk, one<';'>, sblk, forcond, sblk, one<';'>, sblk, nextstatement, sblk, one<')'>, sblk, statement > > {};
 	struct dowhilestatement : seq<TAO_PEGTL_STRING("do"), must< sblk, statement, sblk, TAO_PEGTL_STRING("while"), sblk, one<'('>, sblk, plus< dowhilecond, sblk>, one<')'>, sblk, one<';'> > > {};
 	struct elsestatement : seq<TAO_PEGTL_STRING("else"), sblk, statement > {};
 	struct ifstatement : seq<TAO_PEGTL_STRING("if"), sblk, one<'('>, sblk, plus< ifcond, sblk>, one<')'>, sblk, statement, opt< sblk, elsestatement > > {};
 	struct localscope;
-	struct statement : sor< localscope, localvardecl, breakstatement, returnstatement, forstatement, dowhilestatement, whilestatement, ifstatement, gotostatement, expressionstatement, unknownstatement > {};
+	struct switchstatement;
+	struct statement : sor< localscope, localvardecl, breakstatement, returnstatement, forstatement, dowhilestatement, whilestatement, ifstatement, switchstatement, gotostatement, expressionstatement, unknownstatement > {};
 	struct scopestart : one<'{'> {};
-	struct scope : seq< scopestart, star< sblk, if_then_else< at<label>, label, statement >>, sblk, one<'}'>> {};
+	struct scopestatement : statement {};
+	struct scope : seq< scopestart, star< sblk, if_then_else< at<label>, label, scopestatement >>, sblk, one<'}'>> {};
 	struct funcscope : scope {};
 	struct localscope : scope {};
 
+	struct switchcond : expression {};
+	struct casevalue : sor< literaltrue, literalfalse, literalchar, literalhexa, literaldecimal > {};
+	struct caselabel : seq< TAO_PEGTL_STRING("case"), sblk, casevalue, sblk, one<':'> > {};
+	struct defaultlabel : seq< TAO_PEGTL_STRING("default"), sblk, one<':'> > {};
+	struct switchlabel : sor< caselabel, defaultlabel > {};
+	struct switchscopestart : one<'{'> {};
+	struct switchbody : seq< switchscopestart, star< sblk, if_then_else< at<switchlabel>, switchlabel, if_then_else< at<label>, label, scopestatement > > >, sblk, one<'}'> > {};
+	struct switchstatement : seq< TAO_PEGTL_STRING("switch"), sblk, one<'('>, sblk, switchcond, sblk, one<')'>, sblk, switchbody > {};
+
 	struct paramtype : typespecifier {};
 	struct paramid : identifier {};
 	struct funcparam : seq< paramtype, pblk, paramid> {};
 	struct funcparamlist : seq< sblk, funcparam, star<sblk, one<','>, sblk, funcparam>, sblk > {};
-	struct funcdecl : seq<sblk, functype, pblk, funcid, sblk, one<'('>, opt<funcparamlist>, one<')'>, sblk, sor<funcscope, one<';'>> > {};
+	struct funcheader : seq<functype, pblk, funcid, sblk, one<'('>, opt<funcparamlist>, one<')'> > {};
+	struct funcdecl : seq<sblk, storageclass, funcheader, sblk, sor<funcscope, one<';'>> > {};
+
+	struct tailcallee : funcid {};
+	struct tailcallarg : funcargexpression {};
+	struct tailcallshape : seq< TAO_PEGTL_STRING("return"), sblk, tailcallee, sblk, one<'('>, sblk, opt< list< tailcallarg, seq<sblk, one<','>, sblk> > >, sblk, one<')'>, sblk, one<';'>, eof > {};
+
+	struct structattribute : seq< two<'['>, sblk, TAO_PEGTL_STRING("reorder"), sblk, two<']'> > {};
+	struct structid : identifier {};
+	struct structheader : seq< sblk, TAO_PEGTL_STRING("struct"), pblk, opt< structattribute, sblk >, structid, sblk, one<'{'> > {};
+	struct structfield : seq< compvardecl, sblk, one<';'> > {};
+	struct structdef : seq< structheader, star< sblk, structfield >, sblk, one<'}'>, sblk, one<';'> > {};
+	struct structdecl : if_then_else< at<structheader>, structdef, failure > {};
 
-	struct declaration : sor<funcdecl, globalvardecl> {};
+	struct declaration : sor<structdecl, funcdecl, globalvardecl> {};
 
 	struct unknown : until< one<';'>, any > {};
 	struct program : until< eof, sor<	blank_line,
@@ -291,6 +636,35 @@ namespace DevonC
 		unknown
 	> > {};
 
+	// Include directives looked for ahead of parsing, so that the files they name are read in the background.
+	// Only "#if 0" regions, up to their #else, #elif or #endif, are known dead without the macros : includes
+	// under other false conditions are still read, and stay in the cache unused.
+	struct prefetchcondstart : seq< one<'#'>, star<blank>, sor< TAO_PEGTL_STRING("ifdef"), TAO_PEGTL_STRING("ifndef"), TAO_PEGTL_STRING("if") > > {};
+	struct prefetchcondend : seq< one<'#'>, star<blank>, TAO_PEGTL_STRING("endif") > {};
+	struct prefetchdeadend : seq< one<'#'>, star<blank>, sor< TAO_PEGTL_STRING("else"), TAO_PEGTL_STRING("elif"), TAO_PEGTL_STRING("endif") > > {};
+	struct prefetchnested : seq< prefetchcondstart, until< prefetchcondend, sor< prefetchnested, any > > > {};
+	struct prefetchdead : seq< one<'#'>, star<blank>, TAO_PEGTL_STRING("if"), plus<blank>, one<'0'>, star<blank>, eol,
+		until< at<prefetchdeadend>, sor< prefetchnested, any > > > {};
+	struct prefetchscan : star< sor< prefetchdead, directive_include, any > > {};
+
+	// Shapes looked for by the range analysis, matched against the text of an assignment or a for loop header.
+	struct rangeliteral : sor<literaltrue, literalfalse, literalchar, literalhexa, literaldecimal> {};
+	struct rangeconstant : seq< sblk, rangeliteral, sblk, eof > {};
+	struct rangeassign : seq< identifier, sblk, one<'='>, opt< rangeconstant > > {};
+	struct counterid : identifier {};
+	struct counterbound : sor<literalchar, literalhexa, literaldecimal> {};
+	struct counterstep : sor<literalhexa, literaldecimal> {};
+	struct counterupdate : seq< counterid, sblk, one<'='>, sblk, counterid, sblk, sor<addop, subop>, sblk, counterstep, sblk, eof > {};
+	struct countercond : seq< counterid, sblk, reloperator, sblk, counterbound, sblk, eof > {};
+
+	// Shapes looked for by the dead code elimination.
+	struct jumpshape : seq< sor<returnstatement, breakstatement, gotostatement>, eof > {};
+	struct constcond : rangeliteral {};
+	struct constthen : statement {};
+	struct constelse : statement {};
+	struct constifshape : seq< TAO_PEGTL_STRING("if"), sblk, one<'('>, sblk, constcond, sblk, one<')'>, sblk, constthen, opt< sblk, TAO_PEGTL_STRING("else"), sblk, constelse > > {};
+	struct constwhileshape : seq< TAO_PEGTL_STRING("while"), sblk, one<'('>, sblk, constcond, sblk, one<')'>, sblk, constthen > {};
+
 	template<> struct maction< funcargexpression >
 	{
 		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
@@ -304,6 +678,7 @@ namespace DevonC
 		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
 		{
 			DLOG("FUNCCALL : %s\n", in.string().c_str());
+			Compiler.PushCall(in.string(), in.position().byte);
 		}
 	};
 
@@ -328,6 +703,8 @@ namespace DevonC
 		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
 		{
 			DLOG("PRODUCTEXPRESSION : %s\n", in.string().c_str());
+			const auto & pos = in.position();
+			Compiler.PushExpression(in.string(), pos.byte, pos.line);
 		}
 	};
 
@@ -336,6 +713,8 @@ namespace DevonC
 		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
 		{
 			DLOG("SUMEXPRESSION : %s\n", in.string().c_str());
+			const auto & pos = in.position();
+			Compiler.PushExpression(in.string(), pos.byte, pos.line);
 		}
 	};
 
@@ -421,6 +800,9 @@ namespace DevonC
 		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
 		{
 			DLOG("|| EXPR : %s\n", in.string().c_str());
+			const auto & pos = in.position();
+			if (in.string().find("||") != std::string::npos)
+				Compiler.PushConditional({ pos.byte, pos.byte + in.size(), pos.line });
 		}
 	};
 
@@ -429,6 +811,9 @@ namespace DevonC
 		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
 		{
 			DLOG("&& EXPR : %s\n", in.string().c_str());
+			const auto & pos = in.position();
+			if (in.string().find("&&") != std::string::npos)
+				Compiler.PushConditional({ pos.byte, pos.byte + in.size(), pos.line });
 		}
 	};
 
@@ -472,11 +857,26 @@ namespace DevonC
 		}
 	};
 
+	// The index's own lvalues complete first : keep a pending '&' for the access the index belongs to.
+	template<> struct maction< arrayindexstart >
+	{
+		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
+		{
+			Compiler.SuspendedAddressOf.push_back(Compiler.PendingAddressOf);
+			Compiler.PendingAddressOf = false;
+		}
+	};
+
 	template<> struct maction< arrayindex >
 	{
 		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
 		{
 			DLOG("ARRAYINDEX : %s\n", in.string().c_str());
+			if (!Compiler.SuspendedAddressOf.empty())
+			{
+				Compiler.PendingAddressOf = Compiler.SuspendedAddressOf.back();
+				Compiler.SuspendedAddressOf.pop_back();
+			}
 		}
 	};
 
@@ -493,6 +893,16 @@ namespace DevonC
 		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
 		{
 			DLOG("LVALUE : %s\n", in.string().c_str());
+			const auto & pos = in.position();
+			Compiler.PushVarAccess(in.string(), pos.byte, pos.line);
+		}
+	};
+
+	template<> struct maction< addressop >
+	{
+		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
+		{
+			Compiler.PendingAddressOf = true;
 		}
 	};
 
@@ -501,6 +911,81 @@ namespace DevonC
 		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
 		{
 			DLOG("ASSIGNMENT : %s\n", in.string().c_str());
+			Compiler.PushAssignment(in.string(), in.position().byte);
+		}
+	};
+
+	inline int LiteralValue(const std::string& _Literal)
+	{
+		if (_Literal == "true" || _Literal == "false")
+			return _Literal[0] == 't';
+		if (_Literal[0] == '\'')
+			return _Literal[1];
+		if (_Literal.compare(0, 2, "0x") == 0)
+			return std::stoi(_Literal, nullptr, 16);
+		return std::stoi(_Literal);
+	}
+
+	template< typename Rule > struct rangeaction {};
+
+	template<> struct rangeaction< rangeliteral >
+	{
+		template< typename Input > static void apply(const Input& in, RangeDef& Def)
+		{
+			Def.Value = LiteralValue(in.string());
+		}
+	};
+
+	template<> struct rangeaction< rangeconstant >
+	{
+		template< typename Input > static void apply(const Input& in, RangeDef& Def)
+		{
+			Def.Kind = RangeDefKind::Constant;
+		}
+	};
+
+	template<> struct rangeaction< counterid >
+	{
+		template< typename Input > static void apply(const Input& in, LoopCounter& Counter)
+		{
+			if (Counter.Identifier.empty())
+				Counter.Identifier = in.string();
+			else
+				Counter.IsSameVar &= Counter.Identifier == in.string();
+		}
+	};
+
+	template<> struct rangeaction< subop >
+	{
+		template< typename Input > static void apply(const Input& in, LoopCounter& Counter)
+		{
+			Counter.IsDecrement = true;
+		}
+	};
+
+	template<> struct rangeaction< counterstep >
+	{
+		template< typename Input > static void apply(const Input& in, LoopCounter& Counter)
+		{
+			Counter.Step = LiteralValue(in.string());
+		}
+	};
+
+	template<> struct rangeaction< counterbound >
+	{
+		template< typename Input > static void apply(const Input& in, LoopCounter& Counter)
+		{
+			Counter.Bound = LiteralValue(in.string());
+		}
+	};
+
+	template<ERelopType T> struct rangeaction< relop<T> >
+	{
+		template< typename Input > static void apply(const Input& in, LoopCounter& Counter)
+		{
+			// Only conditions that bound the counter in the direction it moves are useful.
+			Counter.IsValid = Counter.IsDecrement ? (T == Greater || T == GreaterEq) : (T == Lower || T == LowerEq);
+			Counter.BoundAdjust = T == Lower ? -1 : T == Greater ? 1 : 0;
 		}
 	};
 
@@ -509,6 +994,29 @@ namespace DevonC
 		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
 		{
 			DLOG("FORSTATEMENT\n");
+			const auto & pos = in.position();
+			Compiler.PushLoop({ pos.byte, pos.byte + in.size(), pos.line });
+			// The body may run zero times, or break before a value is computed.
+			Compiler.PushConditional({ pos.byte, pos.byte + in.size(), pos.line });
+			Compiler.CloseScope();
+		}
+	};
+
+	template<> struct maction< forscopestart >
+	{
+		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
+		{
+			// Variables declared in the for header live in their own scope, around the loop body.
+			Compiler.OpenScope();
+		}
+	};
+
+	template<> struct maction< forvardecl >
+	{
+		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
+		{
+			DLOG("FORVARDECL : %s\n", in.string().c_str());
+			Compiler.ValidateLocalVar();
 		}
 	};
 
@@ -517,6 +1025,7 @@ namespace DevonC
 		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
 		{
 			DLOG("FORCOND : %s\n", in.string().c_str());
+			Compiler.LastForCond = in.string();
 		}
 	};
 
@@ -525,14 +1034,62 @@ namespace DevonC
 		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
 		{
 			DLOG("NEXTSTATEMENT : %s\n", in.string().c_str());
+			Compiler.PushLoopStep(in.string());
+
+			// Written before the body, but runs after it.
+			const auto & pos = in.position();
+			Compiler.PushConditional({ pos.byte, pos.byte + in.size(), pos.line });
 		}
 	};
 
+	template< typename Rule > struct deadaction {};
+
+	template<> struct deadaction< constcond >
+	{
+		template< typename Input > static void apply(const Input& in, ConstBranch& Branch)
+		{
+			Branch.Value = LiteralValue(in.string());
+		}
+	};
+
+	template<> struct deadaction< constthen >
+	{
+		template< typename Input > static void apply(const Input& in, ConstBranch& Branch)
+		{
+			Branch.Then = { in.position().byte, in.position().byte + in.size(), in.position().line };
+		}
+	};
+
+	template<> struct deadaction< constelse >
+	{
+		template< typename Input > static void apply(const Input& in, ConstBranch& Branch)
+		{
+			Branch.Else = { in.position().byte, in.position().byte + in.size(), in.position().line };
+			Branch.HasElse = true;
+		}
+	};
+
+	// Positions found in the statement text are relative to the statement itself.
+	template< typename Input > void PushConstBranchDeadCode(const Input& in, const ConstBranch& Branch, Compiler& Compiler)
+	{
+		const auto & pos = in.position();
+		const CodeRange& Dead = Branch.Value ? Branch.Else : Branch.Then;
+		if (Branch.Value == 0 || Branch.HasElse)
+			Compiler.PushDeadCode({ pos.byte + Dead.Begin, pos.byte + Dead.End, pos.line + Dead.Line - 1 });
+	}
+
 	template<> struct maction< ifstatement >
 	{
 		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
 		{
 			DLOG("IFSTATEMENT\n");
+			const auto & pos = in.position();
+			Compiler.PushConditional({ pos.byte, pos.byte + in.size(), pos.line });
+
+			ConstBranch Branch;
+			string_input IfInput(in.string(), "");
+			if (parse<constifshape, deadaction>(IfInput, Branch))
+				PushConstBranchDeadCode(in, Branch, Compiler);
 		}
 	};
 
@@ -549,6 +1106,8 @@ namespace DevonC
 		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
 		{
 			DLOG("DO WHILE STATEMENT : %s\n", in.string().c_str());
+			const auto & pos = in.position();
+			Compiler.PushLoop({ pos.byte, pos.byte + in.size(), pos.line });
 		}
 	};
 
@@ -557,6 +1116,15 @@ namespace DevonC
 		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
 		{
 			DLOG("WHILE STATEMENT : %s\n", in.string().c_str());
+			const auto & pos = in.position();
+			Compiler.PushLoop({ pos.byte, pos.byte + in.size(), pos.line });
+			// The body may run zero times, or break before a value is computed.
+			Compiler.PushConditional({ pos.byte, pos.byte + in.size(), pos.line });
+
+			ConstBranch Branch;
+			string_input WhileInput(in.string(), "");
+			if (parse<constwhileshape, deadaction>(WhileInput, Branch))
+				PushConstBranchDeadCode(in, Branch, Compiler);
 		}
 
 		template< typename Input > static void failure(Input& in, Compiler& Compiler)
@@ -581,11 +1149,38 @@ namespace DevonC
 		}
 	};
 
+	template< typename Rule > struct tailcallaction {};
+
+	template<> struct tailcallaction< tailcallee >
+	{
+		template< typename Input > static void apply(const Input& in, TailCall& Call)
+		{
+			Call.Callee = in.string();
+		}
+	};
+
+	template<> struct tailcallaction< tailcallarg >
+	{
+		template< typename Input > static void apply(const Input& in, TailCall& Call)
+		{
+			Call.NbArgs++;
+		}
+	};
+
 	template<> struct maction< returnstatement >
 	{
 		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
 		{
 			DLOG("RETURN STATEMENT : %s\n", in.string().c_str());
+
+			// "return f(...);" : candidate for a tail call, checked against both signatures once the whole program is parsed.
+			TailCall Call;
+			string_input CallInput(in.string(), "");
+			if (parse<tailcallshape, tailcallaction>(CallInput, Call))
+			{
+				Call.Line = in.position().line;
+				Compiler.PushTailCall(std::move(Call));
+			}
 		}
 	};
 
@@ -594,6 +1189,9 @@ namespace DevonC
 		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
 		{
 			DLOG("FUNCPARAM : %s\n", in.string().c_str());
+
+			const auto & pos = in.position();
+			Compiler.PushFuncParam(pos.line);
 		}
 	};
 
@@ -610,6 +1208,17 @@ namespace DevonC
 		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
 		{
 			DLOG("PARAMID : %s\n", in.string().c_str());
+			Compiler.CurVarDecl.Identifier = in.string();
+		}
+	};
+
+	template<> struct maction< scopestatement >
+	{
+		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
+		{
+			const auto & pos = in.position();
+			string_input StatementInput(in.string(), "");
+			Compiler.PushScopeStatement({ pos.byte, pos.byte + in.size(), pos.line }, parse<jumpshape>(StatementInput));
 		}
 	};
 
@@ -618,6 +1227,7 @@ namespace DevonC
 		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
 		{
 			DLOG("LOCALSCOPE END : %s\n", in.string().c_str());
+			Compiler.CloseScope();
 		}
 	};
 
@@ -634,6 +1244,7 @@ namespace DevonC
 		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
 		{
 			DLOG("LABEL : %s\n", in.string().c_str());
+			Compiler.PushLabel(in.position().byte);
 		}
 	};
 
@@ -645,11 +1256,51 @@ namespace DevonC
 		}
 	};
 
+	template<> struct maction< switchscopestart >
+	{
+		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
+		{
+			DLOG("SWITCH START : %s\n", in.string().c_str());
+			Compiler.BeginSwitch();
+		}
+	};
+
+	template<> struct maction< caselabel >
+	{
+		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
+		{
+			DLOG("CASE : %s\n", in.string().c_str());
+			const auto & pos = in.position();
+			Compiler.PushCase(Compiler.CurLiteralValue, pos.byte, pos.line);
+		}
+	};
+
+	template<> struct maction< defaultlabel >
+	{
+		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
+		{
+			DLOG("DEFAULT\n");
+			const auto & pos = in.position();
+			Compiler.PushDefault(pos.byte, pos.line);
+		}
+	};
+
+	template<> struct maction< switchstatement >
+	{
+		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
+		{
+			DLOG("SWITCH STATEMENT : %s\n", in.string().c_str());
+			const auto & pos = in.position();
+			Compiler.EndSwitch({ pos.byte, pos.byte + in.size(), pos.line });
+		}
+	};
+
 	template<> struct maction< scopestart >
 	{
 		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
 		{
 			DLOG("SCOPE START : %s\n", in.string().c_str());
+			Compiler.OpenScope();
 		}
 	};
 
@@ -675,6 +1326,7 @@ namespace DevonC
 		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
 		{
 			DLOG("FUNCTYPE : %s\n", in.string().c_str());
+			Compiler.BeginFuncDecl();
 		}
 	};
 
@@ -709,15 +1361,61 @@ namespace DevonC
 			case 'b':	Compiler.CurVarDecl.Type = VarType::Bool;	break;
 			}
 
+			Compiler.CurVarDecl.Struct = -1;
 			Compiler.CurVarDecl.PointerIndirection = 0;
 		}
 	};
 
+	template<> struct maction< structtypeid >
+	{
+		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
+		{
+			DLOG("STRUCTTYPE : %s\n", in.string().c_str());
+			Compiler.SetStructType(in.string());
+		}
+	};
+
+	template<> struct maction< structattribute >
+	{
+		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
+		{
+			Compiler.PendingReorder = true;
+		}
+	};
+
+	template<> struct maction< structid >
+	{
+		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
+		{
+			DLOG("STRUCTID : %s\n", in.string().c_str());
+			Compiler.BeginStruct(in.string(), in.position().line);
+		}
+	};
+
+	template<> struct maction< structfield >
+	{
+		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
+		{
+			DLOG("STRUCTFIELD : %s\n", in.string().c_str());
+			Compiler.PushStructFields();
+		}
+	};
+
+	template<> struct maction< structdef >
+	{
+		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
+		{
+			DLOG("STRUCTDEF END\n");
+			Compiler.EndStruct();
+		}
+	};
+
 	template<> struct maction< funcid >
 	{
 		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
 		{
 			DLOG("FUNCID : %s\n", in.string().c_str());
+			Compiler.LastFuncId = in.string();
 		}
 	};
 
@@ -729,11 +1427,41 @@ namespace DevonC
 		}
 	};
 
+	template<> struct maction< storageclass >
+	{
+		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
+		{
+			Compiler.PendingStatic = !in.string().empty();
+		}
+	};
+
 	template<> struct maction< funcdecl >
 	{
 		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
 		{
 			DLOG("FUNCDECL IS VALID\n");
+			Compiler.EndFuncDecl();
+		}
+	};
+
+	template<> struct maction< funcheader >
+	{
+		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
+		{
+			DLOG("FUNCHEADER : %s\n", in.string().c_str());
+
+			const auto & pos = in.position();
+			Compiler.DeclareFunction(pos.line);
+		}
+	};
+
+	template<> struct maction< funcscope >
+	{
+		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
+		{
+			DLOG("FUNCSCOPE END\n");
+			Compiler.CloseScope();
+			Compiler.DefineFunction();
 		}
 	};
 
@@ -760,6 +1488,7 @@ namespace DevonC
 		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
 		{
 			DLOG("LOCALVARDECL : %s\n", in.string().c_str());
+			Compiler.ValidateLocalVar();
 		}
 	};
 
@@ -792,20 +1521,70 @@ namespace DevonC
 		}
 	};
 
+	template<> struct maction< includequote >
+	{
+		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
+		{
+			Compiler.IsAngleInclude = false;
+		}
+	};
+
+	template<> struct maction< includeangle >
+	{
+		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
+		{
+			Compiler.IsAngleInclude = true;
+		}
+	};
+
 	template<> struct maction< directive_include >
 	{
 		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
 		{
 			DLOG("INCLUDE : %s\n", Compiler.LastFilename.c_str());
-			if(!Compiler.Compile(Compiler.LastFilename.c_str()))
+			const std::string Filename = Compiler.LastFilename;
+			if(!Compiler.Compile(Compiler.FindInclude(Filename, Compiler.IsAngleInclude).c_str()))
 			{
 				const auto & pos = in.position();
+				Compiler.LastFilename = Filename;
 				Compiler.ErrorMessage(EErrorCode::IncludeFileFail, pos.line);
 			}
 		}
 	};
 
 
+	struct IncludeScan
+	{
+		bool IsAngle = false;
+		std::vector<std::pair<std::string, bool>> Includes;		// Filename, and whether it was between <>.
+	};
+
+	template< typename Rule > struct prefetchaction {};
+
+	template<> struct prefetchaction< includequote >
+	{
+		template< typename Input > static void apply(const Input& in, IncludeScan& Scan)
+		{
+			Scan.IsAngle = false;
+		}
+	};
+
+	template<> struct prefetchaction< includeangle >
+	{
+		template< typename Input > static void apply(const Input& in, IncludeScan& Scan)
+		{
+			Scan.IsAngle = true;
+		}
+	};
+
+	template<> struct prefetchaction< filename >
+	{
+		template< typename Input > static void apply(const Input& in, IncludeScan& Scan)
+		{
+			Scan.Includes.push_back({ in.string(), Scan.IsAngle });
+		}
+	};
+
 	template<> struct maction< program >
 	{
 		template< typename Input > static void apply(const Input& in, Compiler& Compiler)
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace DevonC
+{
+	// Devon16 instructions as emitted by the backend, before encoding. Optimizations mostly look at the class
+	// of an instruction. The mnemonic is kept along for the encoder, its suffix giving the size of a memory
+	// access : ".b" for 8 bits, ".l" for 32 bits, 16 bits without one. Registers hold 32 bits.
+	enum class OpClass : unsigned char
+	{
+		Label,			// Dst : label name
+		Load,			// Dst : register, Src : memory
+		Store,			// Dst : memory, Src : register
+		Move,			// Dst : register, Src : register or immediate
+		Alu,			// Dst : register, Src : register or immediate. Sets the flags from the result, like Compare Dst, #0.
+		Compare,		// Dst, Src : registers or immediates
+		Jump,			// Dst : label name
+		Branch,			// Dst : label name, taken depending on the flags
+		Call,			// Dst : function name
+		Return,
+	};
+
+	struct Instruction
+	{
+		OpClass Class;
+		std::string Opcode;
+		std::string Dst;
+		std::string Src;
+
+		Instruction(OpClass _Class, const std::string& _Opcode, const std::string& _Dst = "", const std::string& _Src = "")
+			: Class(_Class), Opcode(_Opcode), Dst(_Dst), Src(_Src) {};
+	};
+
+	using InstructionList = std::vector<Instruction>;
+
+	// Loads and stores to the first bytes of memory use a shorter addressing mode. The window starts one
+	// word in, so that no global sits at the null address.
+	constexpr unsigned int ShortAddressWindow = 256;
+	constexpr unsigned int ShortWindowStart = 2;
+
+	// Short-address window candidates go by decreasing accesses per byte. The weights are divided by the
+	// sizes first, so that comparing them cannot overflow : only the remainders, smaller than the sizes,
+	// get multiplied.
+	inline bool IsDenser(long long _WeightA, int _SizeA, long long _WeightB, int _SizeB)
+	{
+		if (_WeightA / _SizeA != _WeightB / _SizeB)
+			return _WeightA / _SizeA > _WeightB / _SizeB;
+
+		return (_WeightA % _SizeA) * _SizeB > (_WeightB % _SizeB) * _SizeA;
+	}
+
+	// Functions named __host_... are served by the machine running the program (the simulator) : they have
+	// no code in the image and calls to them are never patched.
+	inline bool IsHostFunction(const std::string& _Name)
+	{
+		return _Name.compare(0, 7, "__host_") == 0;
+	}
+
+	// Devon16 data is stored little-endian.
+	inline void EncodeValue(std::vector<unsigned char>& _Out, int _Value, int _Size)
+	{
+		for (int i = 0; i < _Size; i++)
+			_Out.push_back((unsigned char)((unsigned int)_Value >> (8 * i)));
+	}
+}
@@ -1,22 +1,214 @@
 #include "Compiler.h"
+#include "Linker.h"
+#include "Simulator.h"
+#include "Tests.h"
 #include <iostream>
+#include <fstream>
+#include <thread>
 #include <time.h>
 
+static bool IsObjectFile(const std::string& _Filename)
+{
+	return _Filename.size() > 2 && _Filename.compare(_Filename.size() - 2, 2, ".o") == 0;
+}
+
+// Links the objects into a raw image, written next to the first object unless -o is given.
+static int Link(const std::vector<std::string>& _Objects, std::string _OutputName, const std::string& _MapName)
+{
+	clock_t t = clock();
+
+	DevonC::Linker Linker;
+	for (const auto& ObjName : _Objects)
+		Linker.AddObject(ObjName);
+
+	bool Written = false;
+	if (Linker.GetNbErrors() == 0 && Linker.Link())
+	{
+		if (_OutputName.empty())
+			_OutputName = _Objects.front().substr(0, _Objects.front().find_last_of('.')) + ".rom";
+
+		Written = true;
+		if (!Linker.WriteImage(_OutputName))
+		{
+			printf("Cannot write \"%s\".\n", _OutputName.c_str());
+			Written = false;
+		}
+		if (!_MapName.empty() && !Linker.WriteMap(_MapName))
+		{
+			printf("Cannot write \"%s\".\n", _MapName.c_str());
+			Written = false;
+		}
+	}
+
+	printf("Linked in %fs.\n", float(clock() - t) / CLOCKS_PER_SEC);
+
+	const int NbErr = Linker.GetNbErrors();
+	printf("%d error%s.\n", NbErr, NbErr>1?"s":"");
+
+	return Written ? 0 : 1;
+}
+
+// Runs a listing in the simulator and returns the program's exit code, 1 when the simulation fails.
+static int Run(const char* _Listing, const std::string& _ProfileName)
+{
+	DevonC::Simulator Simulator;
+	const bool Succeeded = Simulator.LoadListing(_Listing) && Simulator.Run();
+	if (!Succeeded)
+		printf("Simulation failed : %s\n", Simulator.GetError().c_str());
+
+	Simulator.DumpStats(std::cout);
+	if (!_ProfileName.empty() && !Simulator.WriteProfile(_ProfileName))
+		printf("Cannot write \"%s\".\n", _ProfileName.c_str());
+	printf("Exit code %d.\n", Simulator.GetExitCode());
+
+	return Succeeded ? Simulator.GetExitCode() : 1;
+}
+
+// DevonC [-S] [-o output] [-jN] [-Idir] [-isystem dir] [-DNAME[=value]] [-fprofile-use=file] source.c
+//	-S : write a textual listing instead of the object.
+//	-I, -isystem : directories searched for included files, -isystem ones after all the -I ones.
+//	-D : defines a macro, to 1 when no value is given.
+//	-j : number of threads reading included files and optimizing functions, one per core by default. The output does not depend on it.
+//	-fprofile-use : execution counts written by the simulator, used to pick the globals placed in the short-address window.
+// DevonC [-o output] [-Map file] objects.o...
+//	Links the objects into a raw image, -Map writes the memory map along.
+// DevonC [-fprofile-generate[=file]] -run listing.s
+//	Runs a listing written with -S in the simulator, and reports cycles, instruction mix and memory traffic.
+//	-fprofile-generate writes the execution counts of the run, to listing.prof by default.
+// DevonC -test
+//	Runs the self-checks, returns the number of failures.
 int main(const int argc, char* argv[])  // NOLINT(bugprone-exception-escape)
 {
-	if (argc > 1)
+	const char* SourceName = nullptr;
+	const char* RunName = nullptr;
+	std::string ProfileUse;
+	std::string ProfileGenerate;
+	std::vector<std::string> ObjectNames;
+	std::string OutputName;
+	std::string MapName;
+	bool Listing = false;
+	int NbThreads = int(std::thread::hardware_concurrency());
+	std::vector<std::pair<std::string, bool>> IncludePaths;
+	std::vector<std::string> Defines;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string Arg = argv[i];
+		if (Arg == "-S")
+			Listing = true;
+		else if (Arg == "-o" && i + 1 < argc)
+			OutputName = argv[++i];
+		else if (Arg == "-isystem" && i + 1 < argc)
+			IncludePaths.push_back({ argv[++i], true });
+		else if (Arg == "-I" && i + 1 < argc)
+			IncludePaths.push_back({ argv[++i], false });
+		else if (Arg.compare(0, 2, "-I") == 0 && Arg.size() > 2)
+			IncludePaths.push_back({ Arg.substr(2), false });
+		else if (Arg == "-D" && i + 1 < argc)
+			Defines.push_back(argv[++i]);
+		else if (Arg.compare(0, 2, "-D") == 0 && Arg.size() > 2)
+			Defines.push_back(Arg.substr(2));
+		else if (Arg.compare(0, 2, "-j") == 0 && Arg.size() > 2)
+			NbThreads = atoi(Arg.c_str() + 2);
+		else if (Arg == "-j" && i + 1 < argc)
+			NbThreads = atoi(argv[++i]);
+		else if (Arg == "-run" && i + 1 < argc)
+			RunName = argv[++i];
+		else if (Arg.compare(0, 14, "-fprofile-use=") == 0)
+			ProfileUse = Arg.substr(14);
+		else if (Arg == "-fprofile-generate")
+			ProfileGenerate = "*";
+		else if (Arg.compare(0, 19, "-fprofile-generate=") == 0)
+			ProfileGenerate = Arg.substr(19);
+		else if (Arg == "-test")
+			return DevonC::RunTests();
+		else if (Arg == "-Map" && i + 1 < argc)
+			MapName = argv[++i];
+		else if (IsObjectFile(Arg))
+			ObjectNames.push_back(Arg);
+		else
+			SourceName = argv[i];
+	}
+
+	if (RunName != nullptr)
+	{
+		if (ProfileGenerate == "*")
+		{
+			ProfileGenerate = RunName;
+			ProfileGenerate = ProfileGenerate.substr(0, ProfileGenerate.find_last_of('.')) + ".prof";
+		}
+
+		return Run(RunName, ProfileGenerate);
+	}
+
+	if (!ObjectNames.empty())
+		return Link(ObjectNames, OutputName, MapName);
+
+	if (SourceName != nullptr)
 	{
 		clock_t t = clock();
 
 		DevonC::Compiler Compiler;
-		Compiler.Compile(argv[1]);
+		Compiler.SetNbThreads(NbThreads);
+		for (const auto& Path : IncludePaths)
+			Compiler.AddIncludePath(Path.first, Path.second);
+		for (const auto& Define : Defines)
+		{
+			if (!Compiler.DefineMacro(Define))
+				printf("Bad macro definition \"%s\".\n", Define.c_str());
+		}
+		bool Compiled = Compiler.Compile(SourceName);
+		if (!ProfileUse.empty() && !Compiler.LoadProfile(ProfileUse.c_str()))
+			printf("Cannot read \"%s\".\n", ProfileUse.c_str());
+
+		// Exceptions from the optimizing threads are rethrown here.
+		try
+		{
+			Compiler.Optimize();
+		}
+		catch (std::exception& err)
+		{
+			std::cout << err.what() << "\n";
+			Compiled = false;
+		}
 
 		printf("Compiled in %fs.\n", float(clock() - t) / CLOCKS_PER_SEC);
 
-		const int NbErr = Compiler.GetNbErrors();
+		// A parse or an optimization aborted by an exception reports no error of its own.
+		const int NbErr = Compiler.GetNbErrors() + (Compiled ? 0 : 1);
 		printf("%d error%s.", NbErr, NbErr>1?"s":"");
 
 		Compiler.DumpDebug();
+
+		if (NbErr == 0)
+		{
+			if (OutputName.empty())
+			{
+				OutputName = SourceName;
+				OutputName = OutputName.substr(0, OutputName.find_last_of('.')) + (Listing ? ".s" : ".o");
+			}
+
+			DevonC::Object Obj;
+			Compiler.EmitObject(Obj);
+
+			if (Listing)
+			{
+				std::ofstream ListingFile(OutputName);
+				Compiler.WriteListing(ListingFile, Obj);
+				if (!ListingFile)
+				{
+					printf("Cannot write \"%s\".\n", OutputName.c_str());
+					return 1;
+				}
+			}
+			else if (!Obj.Write(OutputName))
+			{
+				printf("Cannot write \"%s\".\n", OutputName.c_str());
+				return 1;
+			}
+		}
+
+		return NbErr == 0 ? 0 : 1;
 	}
 
 	return 1;
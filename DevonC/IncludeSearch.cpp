@@ -0,0 +1,112 @@
+#include "IncludeSearch.h"
+
+#include <filesystem>
+
+using namespace DevonC;
+
+static std::string JoinPath(const std::string& _Dir, const std::string& _Filename)
+{
+	if (_Dir.empty() || _Dir == ".")
+		return _Filename;
+
+	return _Dir.back() == '/' || _Dir.back() == '\\' ? _Dir + _Filename : _Dir + "/" + _Filename;
+}
+
+static std::string DirName(const std::string& _Filename)
+{
+	const size_t Slash = _Filename.find_last_of("/\\");
+	return Slash == std::string::npos ? "" : _Filename.substr(0, Slash);
+}
+
+void IncludeSearch::AddPath(const std::string& _Dir, bool _IsSystem)
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+	(_IsSystem ? SystemPaths : Paths).push_back(_Dir);
+}
+
+// Directories that do not exist, or cannot be read, are indexed as empty.
+const std::unordered_map<std::string, bool>& IncludeSearch::ListDir(const std::string& _Dir)
+{
+	const auto It = DirIndex.find(_Dir);
+	if (It != DirIndex.end())
+		return It->second;
+
+	std::unordered_map<std::string, bool>& Entries = DirIndex[_Dir];
+	std::error_code Error;
+	for (std::filesystem::directory_iterator Entry(_Dir.empty() ? "." : _Dir, Error), End; !Error && Entry != End; Entry.increment(Error))
+	{
+		std::error_code TypeError;
+		Entries.emplace(Entry->path().filename().string(), Entry->is_regular_file(TypeError));
+	}
+
+	return Entries;
+}
+
+// Subdirectories in _Filename are followed one index at a time. The last component must be a regular file :
+// a directory of the same name is no include.
+bool IncludeSearch::Exists(const std::string& _Dir, const std::string& _Filename)
+{
+	std::string Dir = _Dir;
+	size_t Begin = 0;
+	for (;;)
+	{
+		const size_t Slash = _Filename.find_first_of("/\\", Begin);
+		const std::string Component = _Filename.substr(Begin, Slash == std::string::npos ? std::string::npos : Slash - Begin);
+		if (Component == "..")
+		{
+			Dir = JoinPath(Dir, Component);
+		}
+		else if (!Component.empty() && Component != ".")
+		{
+			const auto& Entries = ListDir(Dir);
+			const auto Entry = Entries.find(Component);
+			if (Entry == Entries.end() || (Slash == std::string::npos && !Entry->second))
+				return false;
+			Dir = JoinPath(Dir, Component);
+		}
+
+		if (Slash == std::string::npos)
+			return !Component.empty() && Component != "." && Component != "..";
+		Begin = Slash + 1;
+	}
+}
+
+// "file" is looked for next to the including file first, then like <file> : in the -I paths, the -isystem paths,
+// and last as given, relative to the working directory. Returns the path to open, empty if there is none.
+std::string IncludeSearch::Find(const std::string& _Filename, const std::string& _Includer, bool _IsAngle)
+{
+	if (!_Filename.empty() && (_Filename[0] == '/' || _Filename[0] == '\\' || _Filename.find(':') != std::string::npos))
+		return _Filename;
+
+	const std::string IncluderDir = _IsAngle ? "" : DirName(_Includer);
+	const std::string Key = (_IsAngle ? "<" : "\"") + IncluderDir + "|" + _Filename;
+
+	std::lock_guard<std::mutex> Lock(Mutex);
+
+	const auto Cached = Lookups.find(Key);
+	if (Cached != Lookups.end())
+		return Cached->second;
+
+	std::vector<const std::string*> Dirs;
+	if (!_IsAngle && !IncluderDir.empty())
+		Dirs.push_back(&IncluderDir);
+	for (const auto& Dir : Paths)
+		Dirs.push_back(&Dir);
+	for (const auto& Dir : SystemPaths)
+		Dirs.push_back(&Dir);
+
+	static const std::string WorkingDir;
+	Dirs.push_back(&WorkingDir);
+
+	std::string& Found = Lookups[Key];
+	for (const std::string* Dir : Dirs)
+	{
+		if (Exists(*Dir, _Filename))
+		{
+			Found = JoinPath(*Dir, _Filename);
+			break;
+		}
+	}
+
+	return Found;
+}
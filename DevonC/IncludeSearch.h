@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+
+namespace DevonC
+{
+	// Finds included files in the search paths. Each directory is listed once, the first time a lookup
+	// goes through it : later lookups are hash probes, and so are lookups that already failed once.
+	// Safe to call from the prefetching threads.
+	class IncludeSearch
+	{
+		std::vector<std::string> Paths;				// -I
+		std::vector<std::string> SystemPaths;		// -isystem, searched after -I
+		std::unordered_map<std::string, std::unordered_map<std::string, bool>> DirIndex;	// Entry -> is a regular file.
+		std::unordered_map<std::string, std::string> Lookups;		// Empty when not found.
+		std::mutex Mutex;
+
+		const std::unordered_map<std::string, bool>& ListDir(const std::string& _Dir);
+		bool Exists(const std::string& _Dir, const std::string& _Filename);
+
+	public:
+		void AddPath(const std::string& _Dir, bool _IsSystem);
+		std::string Find(const std::string& _Filename, const std::string& _Includer, bool _IsAngle);
+	};
+}
@@ -0,0 +1,485 @@
+#include "Linker.h"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <map>
+#include <algorithm>
+
+using namespace DevonC;
+
+enum class SectionClass : unsigned char
+{
+	Short,
+	Text,
+	ROData,
+	Data,
+	Bss,
+};
+
+static const char* SectionClassNames[] = { ".short", ".text", ".rodata", ".data", ".bss" };
+
+static bool StartsWith(const std::string& _Str, const char* _Prefix)
+{
+	return _Str.compare(0, strlen(_Prefix), _Prefix) == 0;
+}
+
+static SectionClass GetSectionClass(const ObjSection& _Section, bool _InWindow = true)
+{
+	if (_Section.IsBss)
+		return SectionClass::Bss;
+	if (StartsWith(_Section.Name, ".short"))
+		return _InWindow ? SectionClass::Short : SectionClass::Data;
+	if (StartsWith(_Section.Name, ".text"))
+		return SectionClass::Text;
+	if (StartsWith(_Section.Name, ".rodata"))
+		return SectionClass::ROData;
+
+	return SectionClass::Data;
+}
+
+static unsigned int AlignUp(unsigned int _Value, int _Align)
+{
+	return _Align > 1 ? (_Value + _Align - 1) / _Align * _Align : _Value;
+}
+
+void Linker::ErrorMessage(const std::string& _Message)
+{
+	std::cout << "Link : " << _Message << std::endl;
+	++NbErrors;
+}
+
+bool Linker::AddObject(const std::string& _Filename)
+{
+	Object Obj;
+	if (!Obj.Read(_Filename))
+	{
+		ErrorMessage("cannot read object \"" + _Filename + "\"");
+		return false;
+	}
+
+	AddObject(std::move(Obj), _Filename);
+	return true;
+}
+
+void Linker::AddObject(Object&& _Obj, const std::string& _Name)
+{
+	SectionIndices.emplace_back();
+	for (int s = 0; s < int(_Obj.Sections.size()); s++)
+	{
+		SectionIndices.back().push_back(int(InputSections.size()));
+		InputSections.push_back({ int(Objects.size()), s });
+	}
+
+	Objects.push_back(std::move(_Obj));
+	ObjectNames.push_back(_Name);
+}
+
+// Only valid after a successful Link().
+bool Linker::FindSymbolAddress(const std::string& _Name, unsigned int& _Address) const
+{
+	const auto It = SymbolTable.find(_Name);
+	if (It != SymbolTable.end())
+	{
+		_Address = SymbolAddress(It->second.Object, It->second.Symbol);
+		return true;
+	}
+
+	// Local symbols are looked for last, in the first object defining one of that name.
+	for (int o = 0; o < int(Objects.size()); o++)
+	{
+		const int Local = Objects[o].FindSymbol(_Name);
+		if (Local >= 0 && Objects[o].Symbols[Local].Section >= 0)
+		{
+			_Address = SymbolAddress(o, Local);
+			return true;
+		}
+	}
+
+	const auto* LinkerSymbol = FindLinkerSymbol(_Name);
+	if (LinkerSymbol == nullptr)
+		return false;
+
+	_Address = LinkerSymbol->second;
+	return true;
+}
+
+bool Linker::BuildSymbolTable()
+{
+	for (int o = 0; o < int(Objects.size()); o++)
+	{
+		const auto& Symbols = Objects[o].Symbols;
+		for (int i = 0; i < int(Symbols.size()); i++)
+		{
+			if (Symbols[i].Section < 0 || Symbols[i].IsLocal)
+				continue;
+
+			const auto Inserted = SymbolTable.insert({ Symbols[i].Name, { o, i } });
+			if (!Inserted.second)
+				ErrorMessage("multiple definition of '" + Symbols[i].Name + "' in \"" + ObjectNames[o] + "\", first defined in \"" + ObjectNames[Inserted.first->second.Object] + "\"");
+		}
+	}
+
+	return NbErrors == 0;
+}
+
+const std::pair<std::string, unsigned int>* Linker::FindLinkerSymbol(const std::string& _Name) const
+{
+	for (const auto& Symbol : LinkerSymbols)
+		if (Symbol.first == _Name)
+			return &Symbol;
+
+	return nullptr;
+}
+
+// Index in InputSections of the section defining the symbol, -1 if it is defined nowhere.
+int Linker::FindTarget(int _Object, int _Symbol) const
+{
+	const ObjSymbol& Symbol = Objects[_Object].Symbols[_Symbol];
+	if (Symbol.Section >= 0)
+		return SectionIndices[_Object][Symbol.Section];
+
+	const auto It = SymbolTable.find(Symbol.Name);
+	if (It == SymbolTable.end())
+		return -1;
+
+	return SectionIndices[It->second.Object][Objects[It->second.Object].Symbols[It->second.Symbol].Section];
+}
+
+// Only the sections reachable from the entry point through relocations make it to the image.
+void Linker::CollectGarbage(const std::string& _Entry)
+{
+	const auto Entry = SymbolTable.find(_Entry);
+	if (Entry == SymbolTable.end())
+	{
+		ErrorMessage("undefined entry point '" + _Entry + "'");
+		return;
+	}
+
+	// Relocations grouped by input section, so that each section is only scanned once.
+	std::vector<std::vector<std::pair<int, int>>> Refs(InputSections.size());
+	for (int o = 0; o < int(Objects.size()); o++)
+		for (const auto& Reloc : Objects[o].Relocations)
+			Refs[SectionIndices[o][Reloc.Section]].push_back({ o, Reloc.Symbol });
+
+	std::vector<int> WorkList = { FindTarget(Entry->second.Object, Entry->second.Symbol) };
+	InputSections[WorkList.back()].IsKept = true;
+
+	while (!WorkList.empty())
+	{
+		const int Cur = WorkList.back();
+		WorkList.pop_back();
+
+		for (const auto& Ref : Refs[Cur])
+		{
+			const int Target = FindTarget(Ref.first, Ref.second);
+			const std::string& Name = Objects[Ref.first].Symbols[Ref.second].Name;
+			if (Target < 0 && (FindLinkerSymbol(Name) != nullptr || IsHostFunction(Name)))
+				continue;
+
+			if (Target < 0)
+			{
+				ErrorMessage("undefined reference to '" + Name + "' in \"" + ObjectNames[Ref.first] + "\"");
+				continue;
+			}
+
+			if (!InputSections[Target].IsKept)
+			{
+				InputSections[Target].IsKept = true;
+				WorkList.push_back(Target);
+			}
+		}
+	}
+}
+
+// Constant sections with the same contents and no relocations of their own are stored once.
+void Linker::MergeConstants()
+{
+	std::vector<bool> HasRelocs(InputSections.size(), false);
+	for (int o = 0; o < int(Objects.size()); o++)
+		for (const auto& Reloc : Objects[o].Relocations)
+			HasRelocs[SectionIndices[o][Reloc.Section]] = true;
+
+	std::map<std::pair<int, std::vector<unsigned char>>, int> Contents;
+	for (int i = 0; i < int(InputSections.size()); i++)
+	{
+		const ObjSection& Section = GetSection(InputSections[i]);
+		if (!InputSections[i].IsKept || HasRelocs[i] || GetSectionClass(Section) != SectionClass::ROData)
+			continue;
+
+		const auto Inserted = Contents.insert({ { Section.Align, Section.Data }, i });
+		if (!Inserted.second)
+			InputSections[i].MergedInto = Inserted.first->second;
+	}
+}
+
+// Each object offers the whole window to its hottest globals : the kept candidates of all of them
+// compete on accesses per byte, and the ones that do not fit go with .data.
+void Linker::PlaceShortSections()
+{
+	std::vector<int> Candidates;
+	for (int i = 0; i < int(InputSections.size()); i++)
+		if (InputSections[i].IsKept && GetSectionClass(GetSection(InputSections[i])) == SectionClass::Short)
+			Candidates.push_back(i);
+
+	std::stable_sort(Candidates.begin(), Candidates.end(), [this](int _A, int _B)
+	{
+		const ObjSection& A = GetSection(InputSections[_A]);
+		const ObjSection& B = GetSection(InputSections[_B]);
+		return IsDenser(A.AccessWeight, std::max(int(A.Size()), 1), B.AccessWeight, std::max(int(B.Size()), 1));
+	});
+
+	unsigned int Address = ShortWindowStart;
+	for (const int i : Candidates)
+	{
+		const ObjSection& Section = GetSection(InputSections[i]);
+		const unsigned int End = AlignUp(Address, Section.Align) + Section.Size();
+		if (End > ShortAddressWindow)
+			continue;
+
+		InputSections[i].InWindow = true;
+		Address = End;
+	}
+}
+
+// Code keeps the order of the objects. Data is sorted by decreasing alignment then size, which leaves no padding
+// between the sections once the first one is aligned.
+void Linker::Layout()
+{
+	unsigned int Address = ShortWindowStart;
+	for (int c = int(SectionClass::Short); c <= int(SectionClass::Bss); c++)
+	{
+		std::vector<int> Order;
+		for (int i = 0; i < int(InputSections.size()); i++)
+			if (InputSections[i].IsKept && InputSections[i].MergedInto < 0 && int(GetSectionClass(GetSection(InputSections[i]), InputSections[i].InWindow)) == c)
+				Order.push_back(i);
+
+		if (SectionClass(c) != SectionClass::Text)
+		{
+			std::stable_sort(Order.begin(), Order.end(), [this](int _A, int _B)
+			{
+				const ObjSection& A = GetSection(InputSections[_A]);
+				const ObjSection& B = GetSection(InputSections[_B]);
+				if (A.Align != B.Align)
+					return A.Align > B.Align;
+				return A.Size() > B.Size();
+			});
+		}
+
+		if (SectionClass(c) == SectionClass::Text && Address > ShortAddressWindow)
+			ErrorMessage("short-address window overflow : " + std::to_string(Address) + " bytes, " + std::to_string(ShortAddressWindow) + " available");
+
+		if (SectionClass(c) == SectionClass::Bss)
+		{
+			Address = AlignUp(Address, 2);
+			LinkerSymbols[0].second = Address;
+		}
+
+		for (const int i : Order)
+		{
+			const ObjSection& Section = GetSection(InputSections[i]);
+			Address = AlignUp(Address, Section.Align);
+			InputSections[i].Address = Address;
+			Address += Section.Size();
+
+			if (SectionClass(c) != SectionClass::Bss)
+			{
+				Image.resize(InputSections[i].Address, 0);
+				Image.insert(Image.end(), Section.Data.begin(), Section.Data.end());
+			}
+		}
+	}
+
+	Address = AlignUp(Address, 2);
+	LinkerSymbols[1].second = Address;
+	BssSize = Address - (unsigned int)Image.size();
+
+	for (auto& Input : InputSections)
+		if (Input.MergedInto >= 0)
+			Input.Address = InputSections[Input.MergedInto].Address;
+}
+
+unsigned int Linker::SymbolAddress(int _Object, int _Symbol) const
+{
+	int Object = _Object;
+	int Symbol = _Symbol;
+	if (Objects[Object].Symbols[Symbol].Section < 0 && SymbolTable.count(Objects[Object].Symbols[Symbol].Name) > 0)
+	{
+		const SymbolDef& Def = SymbolTable.at(Objects[Object].Symbols[Symbol].Name);
+		Object = Def.Object;
+		Symbol = Def.Symbol;
+	}
+
+	const ObjSymbol& Sym = Objects[Object].Symbols[Symbol];
+	if (Sym.Section < 0)
+		return FindLinkerSymbol(Sym.Name)->second;
+
+	return InputSections[SectionIndices[Object][Sym.Section]].Address + Sym.Offset;
+}
+
+void Linker::ApplyRelocations()
+{
+	for (int o = 0; o < int(Objects.size()); o++)
+	{
+		for (const auto& Reloc : Objects[o].Relocations)
+		{
+			const InputSection& Input = InputSections[SectionIndices[o][Reloc.Section]];
+			if (!Input.IsKept || Input.MergedInto >= 0 || Reloc.Type == RelocType::None
+				|| (FindTarget(o, Reloc.Symbol) < 0 && FindLinkerSymbol(Objects[o].Symbols[Reloc.Symbol].Name) == nullptr))
+				continue;
+
+			const unsigned int Place = Input.Address + Reloc.Offset;
+			unsigned int Value = SymbolAddress(o, Reloc.Symbol);
+			int Size = 2;
+
+			switch (Reloc.Type)
+			{
+			case RelocType::Abs16:
+				if (Value > 0xFFFF)
+					ErrorMessage("'" + Objects[o].Symbols[Reloc.Symbol].Name + "' is out of reach of a 16-bit address in \"" + ObjectNames[o] + "\"");
+				break;
+
+			case RelocType::Abs32:
+				Size = 4;
+				break;
+
+			case RelocType::Rel16:
+			{
+				// Relative to the end of the 16-bit field.
+				const int Delta = int(Value) - int(Place + 2);
+				if (Delta < -0x8000 || Delta > 0x7FFF)
+					ErrorMessage("'" + Objects[o].Symbols[Reloc.Symbol].Name + "' is out of reach of a 16-bit displacement in \"" + ObjectNames[o] + "\"");
+				Value = (unsigned int)Delta;
+				break;
+			}
+
+			default:
+				break;
+			}
+
+			// Within the relocation's own data : past it lies the next section, or the end of the image.
+			if (size_t(Reloc.Offset) + Size > GetSection(Input).Data.size() || Place + Size > Image.size())
+			{
+				ErrorMessage("relocation outside of section " + GetSection(Input).Name + " in \"" + ObjectNames[o] + "\"");
+				continue;
+			}
+
+			for (int i = 0; i < Size; i++)
+				Image[Place + i] = (unsigned char)(Value >> (8 * i));
+		}
+	}
+}
+
+bool Linker::Link(const std::string& _Entry)
+{
+	if (!BuildSymbolTable())
+		return false;
+
+	LinkerSymbols = { { "__bss_start", 0 }, { "__bss_end", 0 } };
+	for (const auto& Symbol : LinkerSymbols)
+		if (SymbolTable.count(Symbol.first) > 0)
+			ErrorMessage("'" + Symbol.first + "' is reserved for the linker");
+
+	CollectGarbage(_Entry);
+	if (NbErrors > 0)
+		return false;
+
+	MergeConstants();
+	PlaceShortSections();
+	Layout();
+	ApplyRelocations();
+
+	return NbErrors == 0;
+}
+
+// The image is built in memory, then written with a single call.
+bool Linker::WriteImage(const std::string& _Filename) const
+{
+	std::ofstream File(_Filename, std::ios::binary);
+	if (!File)
+		return false;
+
+	File.write((const char*)Image.data(), Image.size());
+	return bool(File);
+}
+
+bool Linker::WriteMap(const std::string& _Filename) const
+{
+	std::ofstream Map(_Filename);
+	if (!Map)
+		return false;
+
+	auto Hex = [](unsigned int _Value)
+	{
+		std::ostringstream Str;
+		Str << "0x" << std::hex << std::setw(4) << std::setfill('0') << _Value;
+		return Str.str();
+	};
+
+	struct MapEntry
+	{
+		unsigned int Address;
+		const ObjSymbol* Symbol;
+		int Input;
+	};
+
+	std::vector<MapEntry> Entries;
+	for (int o = 0; o < int(Objects.size()); o++)
+	{
+		for (const auto& Symbol : Objects[o].Symbols)
+		{
+			if (Symbol.Section < 0)
+				continue;
+
+			const int Input = SectionIndices[o][Symbol.Section];
+			if (InputSections[Input].IsKept)
+				Entries.push_back({ InputSections[Input].Address + Symbol.Offset, &Symbol, Input });
+		}
+	}
+
+	std::stable_sort(Entries.begin(), Entries.end(), [](const MapEntry& _A, const MapEntry& _B) { return _A.Address < _B.Address; });
+
+	Map << "Symbols :\n";
+	for (const auto& Entry : Entries)
+	{
+		const InputSection& Input = InputSections[Entry.Input];
+		Map << "\t" << Hex(Entry.Address) << "\t" << std::setw(6) << Entry.Symbol->Size << "  " << Entry.Symbol->Name
+			<< "\t" << GetSection(Input).Name << " (" << ObjectNames[Input.Object] << ")"
+			<< (Input.MergedInto >= 0 ? " merged" : "") << "\n";
+	}
+
+	for (const auto& Symbol : LinkerSymbols)
+		Map << "\t" << Hex(Symbol.second) << "\t" << std::setw(6) << 0 << "  " << Symbol.first << "\t(linker)\n";
+
+	unsigned int Totals[5] = {};
+	unsigned int NbRemoved = 0, RemovedSize = 0, MergedSize = 0;
+
+	Map << "\nRemoved sections :\n";
+	for (const auto& Input : InputSections)
+	{
+		const ObjSection& Section = GetSection(Input);
+		if (!Input.IsKept)
+		{
+			Map << "\t" << std::setw(6) << Section.Size() << "  " << Section.Name << " (" << ObjectNames[Input.Object] << ")\n";
+			NbRemoved++;
+			RemovedSize += Section.Size();
+		}
+		else if (Input.MergedInto >= 0)
+			MergedSize += Section.Size();
+		else
+			Totals[int(GetSectionClass(Section, Input.InWindow))] += Section.Size();
+	}
+
+	Map << "\nTotals :\n";
+	for (int c = 0; c < 5; c++)
+		Map << "\t" << SectionClassNames[c] << "\t" << Totals[c] << " bytes\n";
+
+	const unsigned int Used = (unsigned int)Image.size() + BssSize;
+	Map << "\timage\t" << Image.size() << " bytes, " << Used << " bytes of memory, "
+		<< Used - (Totals[0] + Totals[1] + Totals[2] + Totals[3] + Totals[4]) << " bytes of padding\n";
+	Map << "\tremoved " << NbRemoved << " section" << (NbRemoved != 1 ? "s" : "") << ", " << RemovedSize << " bytes\n";
+	Map << "\tmerged constants, " << MergedSize << " bytes\n";
+
+	return bool(Map);
+}
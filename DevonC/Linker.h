@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Object.h"
+#include "Devon16.h"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace DevonC
+{
+	// Links Devon16 objects into a flat image loaded at address 0 : the short-address window past the first word,
+	// .text, then .rodata, then .data, with .bss right after the end of the image.
+	// The image holds no .bss bytes : whatever loads it zeroes __bss_start to __bss_end, both defined by the linker,
+	// as no startup code is emitted.
+	class Linker
+	{
+		struct InputSection
+		{
+			int Object;
+			int Section;
+			bool IsKept = false;
+			int MergedInto = -1;		// Identical constant section this one was folded into.
+			bool InWindow = false;		// .short section given a place in the short-address window, the others go with .data.
+			unsigned int Address = 0;
+		};
+
+		struct SymbolDef
+		{
+			int Object;
+			int Symbol;
+		};
+
+		std::vector<Object> Objects;
+		std::vector<std::string> ObjectNames;
+		std::vector<std::vector<int>> SectionIndices;	// Per object, index of each of its sections in InputSections.
+		std::vector<InputSection> InputSections;
+		std::unordered_map<std::string, SymbolDef> SymbolTable;
+		std::vector<std::pair<std::string, unsigned int>> LinkerSymbols;
+		std::vector<unsigned char> Image;
+		unsigned int BssSize = 0;
+		int NbErrors = 0;
+
+		const ObjSection& GetSection(const InputSection& _Input) const { return Objects[_Input.Object].Sections[_Input.Section]; }
+		int FindTarget(int _Object, int _Symbol) const;
+		const std::pair<std::string, unsigned int>* FindLinkerSymbol(const std::string& _Name) const;
+		unsigned int SymbolAddress(int _Object, int _Symbol) const;
+		void ErrorMessage(const std::string& _Message);
+
+		bool BuildSymbolTable();
+		void CollectGarbage(const std::string& _Entry);
+		void MergeConstants();
+		void PlaceShortSections();
+		void Layout();
+		void ApplyRelocations();
+
+	public:
+		bool AddObject(const std::string& _Filename);
+		void AddObject(Object&& _Obj, const std::string& _Name);
+		bool Link(const std::string& _Entry = "main");
+		bool FindSymbolAddress(const std::string& _Name, unsigned int& _Address) const;
+		const std::vector<unsigned char>& GetImage() const { return Image; }
+
+		bool WriteImage(const std::string& _Filename) const;
+		bool WriteMap(const std::string& _Filename) const;
+
+		int GetNbErrors() const { return NbErrors; }
+	};
+}
@@ -0,0 +1,269 @@
+#include "Object.h"
+
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <algorithm>
+
+using namespace DevonC;
+
+// File layout, all integers little-endian :
+//	"DVO" 2
+//	u32 NbSections, u32 NbSymbols, u32 NbRelocations
+//	Sections	: str Name, u32 Align, u64 AccessWeight, u8 IsBss, u32 Size, Size bytes of data unless IsBss
+//	Symbols		: str Name, i32 Section, u32 Offset, u32 Size, u8 Flags (1 : function, 2 : local)
+//	Relocations	: i32 Section, u32 Offset, i32 Symbol, u8 Type
+// with str being a u16 length followed by the characters.
+static const unsigned char ObjMagic[4] = { 'D', 'V', 'O', 2 };
+
+static void PutU8(std::vector<unsigned char>& _Buffer, unsigned int _Value)
+{
+	_Buffer.push_back((unsigned char)_Value);
+}
+
+static void PutU16(std::vector<unsigned char>& _Buffer, unsigned int _Value)
+{
+	_Buffer.push_back((unsigned char)(_Value & 0xFF));
+	_Buffer.push_back((unsigned char)((_Value >> 8) & 0xFF));
+}
+
+static void PutU32(std::vector<unsigned char>& _Buffer, unsigned int _Value)
+{
+	PutU16(_Buffer, _Value & 0xFFFF);
+	PutU16(_Buffer, _Value >> 16);
+}
+
+static void PutStr(std::vector<unsigned char>& _Buffer, const std::string& _Str)
+{
+	PutU16(_Buffer, (unsigned int)_Str.size());
+	_Buffer.insert(_Buffer.end(), _Str.begin(), _Str.end());
+}
+
+struct ObjReader
+{
+	std::vector<unsigned char> Buffer;
+	size_t Pos = 0;
+	bool IsValid = true;
+
+	bool Has(size_t _Size)
+	{
+		IsValid &= Pos + _Size <= Buffer.size();
+		return IsValid;
+	}
+
+	unsigned int GetU8()
+	{
+		return Has(1) ? Buffer[Pos++] : 0;
+	}
+
+	unsigned int GetU16()
+	{
+		const unsigned int Low = GetU8();
+		return Low | (GetU8() << 8);
+	}
+
+	unsigned int GetU32()
+	{
+		const unsigned int Low = GetU16();
+		return Low | (GetU16() << 16);
+	}
+
+	// A count of records, each taking at least _RecordSize bytes : a corrupt file cannot make it allocate
+	// more records than its remaining bytes could hold.
+	unsigned int GetCount(size_t _RecordSize)
+	{
+		const unsigned int Count = GetU32();
+		IsValid &= Count <= (Buffer.size() - Pos) / _RecordSize;
+		return IsValid ? Count : 0;
+	}
+
+	std::string GetStr()
+	{
+		const unsigned int Size = GetU16();
+		if (!Has(Size))
+			return "";
+
+		Pos += Size;
+		return std::string(Buffer.begin() + (Pos - Size), Buffer.begin() + Pos);
+	}
+};
+
+int Object::AddSection(const std::string& _Name, int _Align, bool _IsBss)
+{
+	ObjSection Section;
+	Section.Name = _Name;
+	Section.Align = _Align;
+	Section.IsBss = _IsBss;
+	Sections.push_back(std::move(Section));
+
+	return int(Sections.size()) - 1;
+}
+
+int Object::FindSymbol(const std::string& _Name) const
+{
+	for (int i = 0; i < int(Symbols.size()); i++)
+		if (Symbols[i].Name == _Name)
+			return i;
+
+	return -1;
+}
+
+// Returns the symbol of that name, added as undefined if it does not exist yet.
+int Object::AddSymbol(const std::string& _Name)
+{
+	const int Index = FindSymbol(_Name);
+	if (Index >= 0)
+		return Index;
+
+	ObjSymbol Symbol;
+	Symbol.Name = _Name;
+	Symbols.push_back(std::move(Symbol));
+
+	return int(Symbols.size()) - 1;
+}
+
+void Object::AddRelocation(int _Section, unsigned int _Offset, int _Symbol, RelocType _Type)
+{
+	Relocations.push_back({ _Section, _Offset, _Symbol, _Type });
+}
+
+// The whole object is serialized in memory first, then written with a single call.
+bool Object::Write(const std::string& _Filename) const
+{
+	std::vector<unsigned char> Buffer(ObjMagic, ObjMagic + sizeof(ObjMagic));
+
+	PutU32(Buffer, (unsigned int)Sections.size());
+	PutU32(Buffer, (unsigned int)Symbols.size());
+	PutU32(Buffer, (unsigned int)Relocations.size());
+
+	for (const auto& Section : Sections)
+	{
+		PutStr(Buffer, Section.Name);
+		PutU32(Buffer, Section.Align);
+		PutU32(Buffer, (unsigned int)Section.AccessWeight);
+		PutU32(Buffer, (unsigned int)((unsigned long long)Section.AccessWeight >> 32));
+		PutU8(Buffer, Section.IsBss);
+		PutU32(Buffer, Section.Size());
+		if (!Section.IsBss)
+			Buffer.insert(Buffer.end(), Section.Data.begin(), Section.Data.end());
+	}
+
+	for (const auto& Symbol : Symbols)
+	{
+		PutStr(Buffer, Symbol.Name);
+		PutU32(Buffer, (unsigned int)Symbol.Section);
+		PutU32(Buffer, Symbol.Offset);
+		PutU32(Buffer, Symbol.Size);
+		PutU8(Buffer, (Symbol.IsFunction ? 1 : 0) | (Symbol.IsLocal ? 2 : 0));
+	}
+
+	for (const auto& Reloc : Relocations)
+	{
+		PutU32(Buffer, (unsigned int)Reloc.Section);
+		PutU32(Buffer, Reloc.Offset);
+		PutU32(Buffer, (unsigned int)Reloc.Symbol);
+		PutU8(Buffer, (unsigned int)Reloc.Type);
+	}
+
+	std::ofstream File(_Filename, std::ios::binary);
+	if (!File)
+		return false;
+
+	File.write((const char*)Buffer.data(), Buffer.size());
+	return bool(File);
+}
+
+bool Object::Read(const std::string& _Filename)
+{
+	std::ifstream File(_Filename, std::ios::binary);
+	if (!File)
+		return false;
+
+	ObjReader Reader;
+	Reader.Buffer.assign(std::istreambuf_iterator<char>(File), std::istreambuf_iterator<char>());
+	if (!Reader.Has(sizeof(ObjMagic)) || !std::equal(ObjMagic, ObjMagic + sizeof(ObjMagic), Reader.Buffer.begin()))
+		return false;
+	Reader.Pos = sizeof(ObjMagic);
+
+	// Smallest record sizes, with empty names.
+	Sections.resize(Reader.GetCount(2 + 4 + 8 + 1 + 4));
+	Symbols.resize(Reader.GetCount(2 + 4 + 4 + 4 + 1));
+	Relocations.resize(Reader.GetCount(4 + 4 + 4 + 1));
+
+	for (auto& Section : Sections)
+	{
+		Section.Name = Reader.GetStr();
+		Section.Align = Reader.GetU32();
+		const unsigned long long WeightLow = Reader.GetU32();
+		Section.AccessWeight = (long long)(WeightLow | (unsigned long long)Reader.GetU32() << 32);
+		Reader.IsValid &= Section.AccessWeight >= 0;
+		Section.IsBss = Reader.GetU8() != 0;
+
+		const unsigned int Size = Reader.GetU32();
+		if (Section.IsBss)
+			Section.BssSize = Size;
+		else if (Reader.Has(Size))
+		{
+			Section.Data.assign(Reader.Buffer.begin() + Reader.Pos, Reader.Buffer.begin() + Reader.Pos + Size);
+			Reader.Pos += Size;
+		}
+	}
+
+	for (auto& Symbol : Symbols)
+	{
+		Symbol.Name = Reader.GetStr();
+		Symbol.Section = int(Reader.GetU32());
+		Symbol.Offset = Reader.GetU32();
+		Symbol.Size = Reader.GetU32();
+		const unsigned int Flags = Reader.GetU8();
+		Symbol.IsFunction = (Flags & 1) != 0;
+		Symbol.IsLocal = (Flags & 2) != 0;
+		Reader.IsValid &= Symbol.Section >= -1 && Symbol.Section < int(Sections.size());
+	}
+
+	for (auto& Reloc : Relocations)
+	{
+		Reloc.Section = int(Reader.GetU32());
+		Reloc.Offset = Reader.GetU32();
+		Reloc.Symbol = int(Reader.GetU32());
+		Reloc.Type = RelocType(Reader.GetU8());
+		Reader.IsValid &= Reloc.Section >= 0 && Reloc.Section < int(Sections.size())
+			&& Reloc.Symbol >= 0 && Reloc.Symbol < int(Symbols.size())
+			&& Reloc.Type <= RelocType::Rel16;
+	}
+
+	return Reader.IsValid;
+}
+
+void Object::WriteListing(std::ostream& _Out) const
+{
+	static const char* RelocNames[] = { "none", "abs16", "abs32", "rel16" };
+
+	for (int s = 0; s < int(Sections.size()); s++)
+	{
+		const ObjSection& Section = Sections[s];
+		_Out << "\n\t.section " << Section.Name << ", align " << Section.Align << ", " << Section.Size() << " bytes\n";
+
+		for (const auto& Symbol : Symbols)
+			if (Symbol.Section == s)
+				_Out << Symbol.Name << ":\t\t; +" << Symbol.Offset << ", " << Symbol.Size << " bytes" << (Symbol.IsLocal ? ", local" : "") << "\n";
+
+		if (Section.IsBss)
+			continue;
+
+		for (size_t i = 0; i < Section.Data.size(); i++)
+		{
+			_Out << ((i % 16) == 0 ? "\t.byte " : ", ") << "0x" << std::hex << std::setw(2) << std::setfill('0') << int(Section.Data[i]) << std::dec;
+			if ((i % 16) == 15 || i + 1 == Section.Data.size())
+				_Out << "\n";
+		}
+	}
+
+	_Out << "\n";
+	for (const auto& Symbol : Symbols)
+		if (Symbol.Section < 0)
+			_Out << "\t.extern " << Symbol.Name << "\n";
+
+	for (const auto& Reloc : Relocations)
+		_Out << "\t.reloc " << Sections[Reloc.Section].Name << "+" << Reloc.Offset << ", " << RelocNames[int(Reloc.Type)] << ", " << Symbols[Reloc.Symbol].Name << "\n";
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+namespace DevonC
+{
+	enum class RelocType : unsigned char
+	{
+		None,			// Nothing to patch : only records that the section needs the symbol.
+		Abs16,
+		Abs32,
+		Rel16,
+	};
+
+	struct ObjSection
+	{
+		std::string Name;
+		std::vector<unsigned char> Data;
+		unsigned int BssSize = 0;		// Zero-filled sections carry no data.
+		int Align = 1;
+		bool IsBss = false;
+		long long AccessWeight = 0;		// .short sections : the linker gives the window to the most accessed per byte.
+
+		unsigned int Size() const { return IsBss ? BssSize : (unsigned int)Data.size(); }
+	};
+
+	struct ObjSymbol
+	{
+		std::string Name;
+		int Section = -1;				// -1 : undefined, resolved by the linker.
+		unsigned int Offset = 0;
+		unsigned int Size = 0;
+		bool IsFunction = false;
+		bool IsLocal = false;			// Only resolves references from its own object.
+	};
+
+	struct ObjRelocation
+	{
+		int Section = -1;
+		unsigned int Offset = 0;
+		int Symbol = -1;
+		RelocType Type = RelocType::None;
+	};
+
+	// Devon16 object, built in memory by the compiler and written in one go.
+	class Object
+	{
+	public:
+		std::vector<ObjSection> Sections;
+		std::vector<ObjSymbol> Symbols;
+		std::vector<ObjRelocation> Relocations;
+
+		int AddSection(const std::string& _Name, int _Align, bool _IsBss);
+		int FindSymbol(const std::string& _Name) const;
+		int AddSymbol(const std::string& _Name);
+		void AddRelocation(int _Section, unsigned int _Offset, int _Symbol, RelocType _Type);
+
+		bool Write(const std::string& _Filename) const;
+		bool Read(const std::string& _Filename);
+		void WriteListing(std::ostream& _Out) const;
+	};
+}
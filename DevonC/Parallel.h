@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+namespace DevonC
+{
+	// Calls _Func(Index, Worker) for every Index in [0, _Count), on _NbWorkers threads including the calling one.
+	// Indices are handed out one at a time, so the work spreads evenly whatever each item costs. Worker is in
+	// [0, _NbWorkers) : per-worker state indexed by it needs no locking, and merging it in worker order
+	// keeps the result independent of the scheduling as long as the merge is order-insensitive.
+	// An exception stops handing out indices and is rethrown on the calling thread once all the workers are done.
+	// Indices are handed out in order, so every lower one has run by then : the lowest failing index is the one
+	// rethrown, whatever the number of threads.
+	template< typename Func > void ParallelFor(size_t _Count, int _NbWorkers, Func&& _Func)
+	{
+		const int NbWorkers = std::max(1, std::min(_NbWorkers, int(_Count)));
+		std::atomic<size_t> Next(0);
+		std::mutex ErrorMutex;
+		std::exception_ptr Error;
+		size_t ErrorIndex = _Count;
+
+		auto Work = [&](int _Worker)
+		{
+			for (size_t Index = Next++; Index < _Count; Index = Next++)
+			{
+				try
+				{
+					_Func(Index, _Worker);
+				}
+				catch (...)
+				{
+					std::lock_guard<std::mutex> Lock(ErrorMutex);
+					if (Index < ErrorIndex)
+					{
+						Error = std::current_exception();
+						ErrorIndex = Index;
+					}
+					Next = _Count;
+				}
+			}
+		};
+
+		std::vector<std::thread> Threads;
+		for (int w = 1; w < NbWorkers; w++)
+			Threads.emplace_back(Work, w);
+
+		Work(0);
+
+		for (auto& Thread : Threads)
+			Thread.join();
+
+		if (Error)
+			std::rethrow_exception(Error);
+	}
+}
@@ -0,0 +1,186 @@
+#include "Peephole.h"
+
+#include <map>
+#include <sstream>
+#include <iostream>
+#include <cstring>
+
+using namespace DevonC;
+
+static PeepholeOutput Keep(int _Index)
+{
+	return { _Index, OpClass::Label, "", "", "" };
+}
+
+static PeepholeOutput Emit(OpClass _Class, const char* _Opcode, const char* _Dst, const char* _Src = "")
+{
+	return { -1, _Class, _Opcode, _Dst, _Src };
+}
+
+static const std::vector<PeepholeRule> Rules =
+{
+	// st.l [m], r ; ld.l d, [m]	->	st.l [m], r ; mov d, r
+	// Narrower loads truncate and sign-extend what was stored : only full-width accesses give r back.
+	{ "store-load",		{ { OpClass::Store, "st.l", "$m", "$r" }, { OpClass::Load, "ld.l", "$d", "$m" } },	{ Keep(0), Emit(OpClass::Move, "mov", "$d", "$r") } },
+
+	// ld r, [m] ; st [m], r		->	ld r, [m]
+	// Storing back what was loaded, at the same size, leaves memory as it was. Unless the load replaced
+	// a register of the address : the store then goes elsewhere.
+	{ "load-store",		{ { OpClass::Load, "ld$s", "$r", "$m" }, { OpClass::Store, "st$s", "$m", "$r" } },	{ Keep(0) },	{ { "$r", "$m" } } },
+
+	// mov r, r						->
+	{ "self-move",		{ { OpClass::Move, "*", "$r", "$r" } },												{} },
+
+	// jmp l ; l:					->	l:
+	{ "jump-next",		{ { OpClass::Jump, "*", "$l", "" }, { OpClass::Label, "*", "$l", "" } },			{ Keep(1) } },
+
+	// b?? l ; l:					->	l:
+	{ "branch-next",	{ { OpClass::Branch, "*", "$l", "" }, { OpClass::Label, "*", "$l", "" } },			{ Keep(1) } },
+
+	// alu r, x ; cmp r, #0			->	alu r, x
+	{ "compare-zero",	{ { OpClass::Alu, "*", "$r", "*" }, { OpClass::Compare, "*", "$r", "#0" } },		{ Keep(0) } },
+};
+
+static bool MatchOperand(const char* _Pattern, const std::string& _Operand, std::map<std::string, std::string>& _Bindings)
+{
+	if (_Pattern[0] == '*')
+		return true;
+
+	if (_Pattern[0] != '$')
+		return _Operand == _Pattern;
+
+	auto Binding = _Bindings.find(_Pattern);
+	if (Binding == _Bindings.end())
+	{
+		_Bindings.emplace(_Pattern, _Operand);
+		return true;
+	}
+
+	return Binding->second == _Operand;
+}
+
+static bool MatchOpcode(const char* _Pattern, const std::string& _Opcode, std::map<std::string, std::string>& _Bindings)
+{
+	const char* Binding = strchr(_Pattern, '$');
+	if (Binding == nullptr || Binding == _Pattern)
+		return MatchOperand(_Pattern, _Opcode, _Bindings);
+
+	const size_t Length = size_t(Binding - _Pattern);
+	return _Opcode.compare(0, Length, _Pattern, Length) == 0 && MatchOperand(Binding, _Opcode.substr(Length), _Bindings);
+}
+
+// Splits "[r0 + 4]" into its terms, as the simulator does to compute the address.
+static bool HasTerm(const std::string& _Address, const std::string& _Term)
+{
+	if (_Address.size() < 3 || _Address.front() != '[' || _Address.back() != ']')
+		return false;
+
+	std::istringstream Terms(_Address.substr(1, _Address.size() - 2));
+	std::string Term;
+	while (std::getline(Terms, Term, '+'))
+	{
+		const size_t Begin = Term.find_first_not_of(" \t");
+		if (Begin != std::string::npos && Term.substr(Begin, Term.find_last_not_of(" \t") + 1 - Begin) == _Term)
+			return true;
+	}
+	return false;
+}
+
+static std::string Substitute(const char* _Pattern, const std::map<std::string, std::string>& _Bindings)
+{
+	auto Binding = _Bindings.find(_Pattern);
+	return Binding == _Bindings.end() ? std::string(_Pattern) : Binding->second;
+}
+
+Peephole::Peephole()
+	: Stats(Rules.size())
+{
+}
+
+bool Peephole::ApplyRule(InstructionList& _Code, size_t _Pos, size_t _RuleIndex)
+{
+	const PeepholeRule& Rule = Rules[_RuleIndex];
+	if (_Pos + Rule.Match.size() > _Code.size())
+		return false;
+
+	std::map<std::string, std::string> Bindings;
+	for (size_t i = 0; i < Rule.Match.size(); i++)
+	{
+		const PeepholePattern& Pattern = Rule.Match[i];
+		const Instruction& Instr = _Code[_Pos + i];
+		if (Instr.Class != Pattern.Class
+			|| !MatchOpcode(Pattern.Opcode, Instr.Opcode, Bindings)
+			|| !MatchOperand(Pattern.Dst, Instr.Dst, Bindings)
+			|| !MatchOperand(Pattern.Src, Instr.Src, Bindings))
+			return false;
+	}
+
+	for (const auto& NotIn : Rule.NotIn)
+		if (HasTerm(Substitute(NotIn.second, Bindings), Substitute(NotIn.first, Bindings)))
+			return false;
+
+	InstructionList Replacement;
+	for (const PeepholeOutput& Output : Rule.Replace)
+	{
+		if (Output.Keep >= 0)
+			Replacement.push_back(_Code[_Pos + Output.Keep]);
+		else
+			Replacement.emplace_back(Output.Class, Output.Opcode, Substitute(Output.Dst, Bindings), Substitute(Output.Src, Bindings));
+	}
+
+	_Code.erase(_Code.begin() + _Pos, _Code.begin() + _Pos + Rule.Match.size());
+	_Code.insert(_Code.begin() + _Pos, Replacement.begin(), Replacement.end());
+
+	Stats[_RuleIndex].NbApplied++;
+	Stats[_RuleIndex].NbRemoved += int(Rule.Match.size()) - int(Rule.Replace.size());
+	return true;
+}
+
+// Slides every rule over the code, again and again until a whole pass changes nothing.
+int Peephole::Run(InstructionList& _Code)
+{
+	if (_Code.empty())
+		return 0;
+
+	const size_t InitialSize = _Code.size();
+
+	bool Changed = true;
+	while (Changed)
+	{
+		Changed = false;
+		NbPasses++;
+
+		for (size_t Pos = 0; Pos < _Code.size(); Pos++)
+		{
+			for (size_t RuleIndex = 0; RuleIndex < Rules.size(); RuleIndex++)
+			{
+				if (ApplyRule(_Code, Pos, RuleIndex))
+				{
+					Changed = true;
+					RuleIndex = size_t(-1);		// The replacement may start a new match at the same position.
+					if (Pos >= _Code.size())
+						break;
+				}
+			}
+		}
+	}
+
+	return int(InitialSize - _Code.size());
+}
+
+void Peephole::Merge(const Peephole& _Other)
+{
+	for (size_t i = 0; i < Stats.size(); i++)
+	{
+		Stats[i].NbApplied += _Other.Stats[i].NbApplied;
+		Stats[i].NbRemoved += _Other.Stats[i].NbRemoved;
+	}
+	NbPasses += _Other.NbPasses;
+}
+
+void Peephole::DumpStats() const
+{
+	std::cout << "\nPeephole (" << NbPasses << " pass" << (NbPasses != 1 ? "es" : "") << "):\n";
+	for (size_t i = 0; i < Rules.size(); i++)
+		std::cout << "\t" << Rules[i].Name << " : applied " << Stats[i].NbApplied << ", " << Stats[i].NbRemoved << " instruction(s) removed\n";
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Devon16.h"
+
+namespace DevonC
+{
+	// Operands in patterns : "$name" binds to the operand and must match it everywhere else in the rule,
+	// "*" matches anything, anything else must match literally. Opcodes match the same way, except that
+	// a "$name" may follow a literal mnemonic, binding its size suffix : "ld$s" matches "ld.b" with $s = ".b".
+	struct PeepholePattern
+	{
+		OpClass Class;
+		const char* Opcode;
+		const char* Dst;
+		const char* Src;
+	};
+
+	// Keep >= 0 copies the matched instruction at that index, otherwise a new instruction is built
+	// from the class, the mnemonic and the operand patterns, with the bound operands substituted.
+	struct PeepholeOutput
+	{
+		int Keep;
+		OpClass Class;
+		const char* Opcode;
+		const char* Dst;
+		const char* Src;
+	};
+
+	// A rule must either shrink the code or produce something that no rule matches again,
+	// so that iterating to a fixed point terminates. Each NotIn pair rejects the match when the first
+	// binding is a term of the second, an address : "$r" in "$m" with $r = r0 and $m = [r0 + 4].
+	struct PeepholeRule
+	{
+		const char* Name;
+		std::vector<PeepholePattern> Match;
+		std::vector<PeepholeOutput> Replace;
+		std::vector<std::pair<const char*, const char*>> NotIn;
+	};
+
+	class Peephole
+	{
+		struct RuleStats
+		{
+			int NbApplied = 0;
+			int NbRemoved = 0;
+		};
+
+		std::vector<RuleStats> Stats;
+		int NbPasses = 0;
+
+		bool ApplyRule(InstructionList& _Code, size_t _Pos, size_t _RuleIndex);
+
+	public:
+		Peephole();
+
+		int Run(InstructionList& _Code);
+		void Merge(const Peephole& _Other);
+		void DumpStats() const;
+	};
+}
@@ -0,0 +1,1143 @@
+#include "Preprocessor.h"
+
+#include <cstring>
+#include <cstdlib>
+#include <climits>
+#include <algorithm>
+
+using namespace DevonC;
+
+static const int MaxIncludeDepth = 200;
+
+static bool IsIdentStart(char _C)
+{
+	return (_C >= 'a' && _C <= 'z') || (_C >= 'A' && _C <= 'Z') || _C == '_';
+}
+
+static bool IsIdentChar(char _C)
+{
+	return IsIdentStart(_C) || (_C >= '0' && _C <= '9');
+}
+
+static bool IsSpace(char _C)
+{
+	return _C == ' ' || _C == '\t' || _C == '\r' || _C == '\f' || _C == '\v';
+}
+
+static bool IsDigit(char _C)
+{
+	return _C >= '0' && _C <= '9';
+}
+
+// Longest first, so that the first match is the one to take.
+static const char* Punctuators[] =
+{
+	"<<=", ">>=", "...",
+	"##", "->", "++", "--", "<<", ">>", "<=", ">=", "==", "!=", "&&", "||",
+	"+=", "-=", "*=", "/=", "%=", "&=", "|=", "^=",
+};
+
+static void Tokenize(const std::string& _Text, size_t _Line, std::vector<PPToken>& _Tokens)
+{
+	size_t Pos = 0;
+	while (Pos < _Text.size())
+	{
+		PPToken Token;
+		Token.Line = _Line;
+		const size_t Begin = Pos;
+		const char C = _Text[Pos];
+
+		if (C == '\n')
+		{
+			Token.Kind = PPTokenKind::Newline;
+			++Pos;
+			++_Line;
+		}
+		else if (IsSpace(C))
+		{
+			Token.Kind = PPTokenKind::Space;
+			while (Pos < _Text.size() && IsSpace(_Text[Pos]))
+				++Pos;
+		}
+		else if (IsIdentStart(C))
+		{
+			Token.Kind = PPTokenKind::Identifier;
+			while (Pos < _Text.size() && IsIdentChar(_Text[Pos]))
+				++Pos;
+		}
+		else if (IsDigit(C) || (C == '.' && Pos + 1 < _Text.size() && IsDigit(_Text[Pos + 1])))
+		{
+			Token.Kind = PPTokenKind::Number;
+			while (Pos < _Text.size() && (IsIdentChar(_Text[Pos]) || _Text[Pos] == '.'
+				|| ((_Text[Pos] == '+' || _Text[Pos] == '-') && strchr("eEpP", _Text[Pos - 1]))))
+				++Pos;
+		}
+		else if (C == '"' || C == '\'')
+		{
+			Token.Kind = PPTokenKind::String;
+			for (++Pos; Pos < _Text.size() && _Text[Pos] != C && _Text[Pos] != '\n'; ++Pos)
+			{
+				if (_Text[Pos] == '\\' && Pos + 1 < _Text.size())
+					++Pos;
+			}
+			if (Pos < _Text.size() && _Text[Pos] == C)
+				++Pos;
+		}
+		else
+		{
+			Token.Kind = PPTokenKind::Punct;
+			size_t Length = 1;
+			for (const char* Punctuator : Punctuators)
+			{
+				const size_t PunctLength = strlen(Punctuator);
+				if (_Text.compare(Pos, PunctLength, Punctuator) == 0)
+				{
+					Length = PunctLength;
+					break;
+				}
+			}
+			Pos += Length;
+		}
+
+		Token.Text = _Text.substr(Begin, Pos - Begin);
+		_Tokens.push_back(std::move(Token));
+	}
+}
+
+static bool IsBlank(const PPToken& _Token)
+{
+	return _Token.Kind == PPTokenKind::Space || _Token.Kind == PPTokenKind::Newline;
+}
+
+static size_t SkipBlanks(const std::vector<PPToken>& _Tokens, size_t _Pos)
+{
+	while (_Pos < _Tokens.size() && IsBlank(_Tokens[_Pos]))
+		++_Pos;
+	return _Pos;
+}
+
+static bool InHideSet(const PPToken& _Token, const std::string& _Name)
+{
+	for (const auto& Name : _Token.HideSet)
+	{
+		if (Name == _Name)
+			return true;
+	}
+	return false;
+}
+
+// Tokens that came out of an expansion may end up next to each other : a space keeps them from reading as one.
+static bool NeedsSpace(const std::string& _Out, const std::string& _Next)
+{
+	if (_Out.empty() || _Next.empty())
+		return false;
+
+	const char Last = _Out.back();
+	const char First = _Next[0];
+	if (IsIdentChar(Last) && IsIdentChar(First))
+		return true;
+
+	const char Pair[3] = { Last, First, '\0' };
+	if (strcmp(Pair, "//") == 0 || strcmp(Pair, "/*") == 0)
+		return true;
+	for (const char* Punctuator : Punctuators)
+	{
+		if (strncmp(Punctuator, Pair, 2) == 0)
+			return true;
+	}
+	return false;
+}
+
+static void AppendTokens(const std::vector<PPToken>& _Tokens, std::string& _Out)
+{
+	for (const auto& Token : _Tokens)
+	{
+		if (Token.Kind != PPTokenKind::Space && NeedsSpace(_Out, Token.Text))
+			_Out += ' ';
+		_Out += Token.Text;
+	}
+}
+
+static std::string Spell(const std::vector<PPToken>& _Tokens)
+{
+	std::string Text;
+	for (const auto& Token : _Tokens)
+	{
+		if (IsBlank(Token))
+		{
+			if (!Text.empty() && Text.back() != ' ')
+				Text += ' ';
+		}
+		else
+		{
+			Text += Token.Text;
+		}
+	}
+
+	if (!Text.empty() && Text.back() == ' ')
+		Text.pop_back();
+	return Text;
+}
+
+static PPToken Stringize(const std::vector<PPToken>& _Arg, size_t _Line)
+{
+	PPToken Token;
+	Token.Kind = PPTokenKind::String;
+	Token.Line = _Line;
+	Token.Text = "\"";
+	for (const char C : Spell(_Arg))
+	{
+		if (C == '"' || C == '\\')
+			Token.Text += '\\';
+		Token.Text += C;
+	}
+	Token.Text += '"';
+	return Token;
+}
+
+// Most lines use no macro at all : they are copied as they are, without being tokenized.
+bool Preprocessor::HasMacros(const std::string& _Line) const
+{
+	for (size_t Pos = 0; Pos < _Line.size();)
+	{
+		const char C = _Line[Pos];
+		if (IsIdentStart(C))
+		{
+			const size_t Begin = Pos;
+			while (Pos < _Line.size() && IsIdentChar(_Line[Pos]))
+				++Pos;
+
+			const std::string Name = _Line.substr(Begin, Pos - Begin);
+			if (Macros.count(Name) != 0 || Name == "__LINE__" || Name == "__FILE__")
+				return true;
+		}
+		else if (IsDigit(C))
+		{
+			while (Pos < _Line.size() && (IsIdentChar(_Line[Pos]) || _Line[Pos] == '.'))
+				++Pos;
+		}
+		else if (C == '"' || C == '\'')
+		{
+			for (++Pos; Pos < _Line.size() && _Line[Pos] != C; ++Pos)
+			{
+				if (_Line[Pos] == '\\')
+					++Pos;
+			}
+			++Pos;
+		}
+		else
+		{
+			++Pos;
+		}
+	}
+	return false;
+}
+
+void Preprocessor::Error(size_t _Line, const std::string& _Message)
+{
+	if (Host != nullptr)
+		Host->Error(FileStack.back(), _Line, _Message);
+}
+
+bool Preprocessor::Define(const std::string& _Definition)
+{
+	const size_t Equal = _Definition.find('=');
+	std::string Line = _Definition.substr(0, Equal) + " " + (Equal == std::string::npos ? "1" : _Definition.substr(Equal + 1));
+
+	std::vector<PPToken> Tokens;
+	Tokenize(Line, 0, Tokens);
+	return DefineMacro(Tokens, 0, 0);
+}
+
+void Preprocessor::Run(const std::string& _Path, const PreprocessorHost& _Host, std::deque<PreprocessedFile>& _Files)
+{
+	// Each translation unit starts over from the -D macros.
+	const auto CommandLineMacros = Macros;
+
+	Host = &_Host;
+	Files = &_Files;
+	ProcessFile(_Path);
+	Macros = CommandLineMacros;
+	Host = nullptr;
+	Files = nullptr;
+}
+
+void Preprocessor::ProcessFile(const std::string& _Path)
+{
+	const size_t Slot = Files->size();
+	Files->push_back({ _Path, "", "" });
+
+	std::string Source;
+	try
+	{
+		Source = Host->Load(_Path);
+	}
+	catch (std::exception& err)
+	{
+		(*Files)[Slot].Error = err.what();
+		return;
+	}
+
+	FileStack.push_back(_Path);
+
+	std::string Out;
+	Out.reserve(Source.size());
+	std::vector<Conditional> Conds;
+	std::deque<PPToken> Pending;		// A macro call that may go on over the next lines.
+	size_t LineNum = 1;
+
+	auto Flush = [&](bool _HasMore)
+	{
+		std::vector<PPToken> Expanded;
+		Expand(Pending, Expanded, _HasMore);
+		AppendTokens(Expanded, Out);
+	};
+
+	size_t Pos = 0;
+	while (Pos < Source.size())
+	{
+		const char* LineEnd = static_cast<const char*>(memchr(Source.data() + Pos, '\n', Source.size() - Pos));
+		size_t End = LineEnd ? LineEnd - Source.data() : Source.size();
+
+		size_t First = Pos;
+		while (First < End && (Source[First] == ' ' || Source[First] == '\t'))
+			++First;
+		const bool IsDirective = First < End && Source[First] == '#';
+		const bool IsActive = Conds.empty() || Conds.back().IsActive;
+
+		// Skipped lines are not even tokenized : only directives are looked at, for the nesting.
+		if (!IsDirective && !IsActive)
+		{
+			Out += '\n';
+			++LineNum;
+			Pos = End + 1;
+			continue;
+		}
+
+		// Backslash-newline joins lines, mostly useful for long #defines.
+		const size_t LineStart = Pos;
+		std::string Line = Source.substr(Pos, End - Pos);
+		size_t NbLines = 1;
+		for (;;)
+		{
+			size_t Last = Line.size();
+			if (Last > 0 && Line[Last - 1] == '\r')
+				--Last;
+			if (Last == 0 || Line[Last - 1] != '\\' || End >= Source.size())
+				break;
+
+			Line.resize(Last - 1);
+			const size_t Next = End + 1;
+			LineEnd = static_cast<const char*>(memchr(Source.data() + Next, '\n', Source.size() - Next));
+			End = LineEnd ? LineEnd - Source.data() : Source.size();
+			Line.append(Source, Next, End - Next);
+			++NbLines;
+		}
+		Pos = End + 1;
+
+		if (IsDirective)
+		{
+			Flush(false);
+			Directive(Line.substr(First - LineStart + 1), LineNum, Conds, Out);
+			Out.append(NbLines, '\n');
+		}
+		else if (Pending.empty() && !HasMacros(Line))
+		{
+			Out += Line;
+			Out.append(NbLines, '\n');
+		}
+		else
+		{
+			std::vector<PPToken> Tokens;
+			Tokenize(Line, LineNum, Tokens);
+			Tokens.resize(Tokens.size() + NbLines);
+			for (size_t l = 0; l < NbLines; l++)
+			{
+				PPToken& Newline = Tokens[Tokens.size() - NbLines + l];
+				Newline.Kind = PPTokenKind::Newline;
+				Newline.Text = "\n";
+				Newline.Line = LineNum + l;
+			}
+
+			Pending.insert(Pending.end(), std::make_move_iterator(Tokens.begin()), std::make_move_iterator(Tokens.end()));
+			Flush(true);
+		}
+
+		LineNum += NbLines;
+	}
+
+	Flush(false);
+
+	for (const auto& Cond : Conds)
+		Error(Cond.Line, "unterminated conditional directive.");
+
+	FileStack.pop_back();
+	(*Files)[Slot].Text = std::move(Out);
+}
+
+// _Line is what follows the '#'. Whatever the directive writes to _Out stays on its line : the caller ends it.
+void Preprocessor::Directive(const std::string& _Line, size_t _LineNum, std::vector<Conditional>& _Conds, std::string& _Out)
+{
+	std::vector<PPToken> Tokens;
+	Tokenize(_Line, _LineNum, Tokens);
+
+	size_t Pos = SkipBlanks(Tokens, 0);
+	if (Pos == Tokens.size())
+		return;		// Null directive.
+
+	const std::string& Name = Tokens[Pos].Text;
+	Pos = SkipBlanks(Tokens, Pos + 1);
+	const bool IsActive = _Conds.empty() || _Conds.back().IsActive;
+
+	if (Name == "if" || Name == "ifdef" || Name == "ifndef")
+	{
+		bool IsTrue = false;
+		if (IsActive)
+		{
+			if (Name == "if")
+			{
+				IsTrue = EvalCondition(Tokens, Pos, _LineNum);
+			}
+			else if (Pos == Tokens.size() || Tokens[Pos].Kind != PPTokenKind::Identifier)
+			{
+				Error(_LineNum, "#" + Name + " expects a macro name.");
+			}
+			else
+			{
+				IsTrue = (Macros.count(Tokens[Pos].Text) != 0) == (Name == "ifdef");
+			}
+		}
+		_Conds.push_back({ IsTrue, IsTrue || !IsActive, false, _LineNum });
+	}
+	else if (Name == "elif" || Name == "else")
+	{
+		if (_Conds.empty())
+		{
+			Error(_LineNum, "#" + Name + " without #if.");
+			return;
+		}
+
+		Conditional& Cond = _Conds.back();
+		if (Cond.HasElse)
+			Error(_LineNum, "#" + Name + " after #else.");
+
+		if (Cond.WasTaken)
+			Cond.IsActive = false;
+		else
+			Cond.IsActive = Name == "else" || EvalCondition(Tokens, Pos, _LineNum);
+
+		Cond.WasTaken |= Cond.IsActive;
+		Cond.HasElse |= Name == "else";
+	}
+	else if (Name == "endif")
+	{
+		if (_Conds.empty())
+			Error(_LineNum, "#endif without #if.");
+		else
+			_Conds.pop_back();
+	}
+	else if (!IsActive)
+	{
+		return;
+	}
+	else if (Name == "define")
+	{
+		DefineMacro(Tokens, Pos, _LineNum);
+	}
+	else if (Name == "undef")
+	{
+		if (Pos == Tokens.size() || Tokens[Pos].Kind != PPTokenKind::Identifier)
+			Error(_LineNum, "#undef expects a macro name.");
+		else
+			Macros.erase(Tokens[Pos].Text);
+	}
+	else if (Name == "include")
+	{
+		Include(Tokens, Pos, _LineNum, _Out);
+	}
+	else if (Name == "error")
+	{
+		Error(_LineNum, "#error " + Spell(std::vector<PPToken>(Tokens.begin() + Pos, Tokens.end())));
+	}
+	else if (Name != "pragma" && Name != "line")
+	{
+		Error(_LineNum, "unknown directive '#" + Name + "'.");
+	}
+}
+
+bool Preprocessor::DefineMacro(const std::vector<PPToken>& _Tokens, size_t _Pos, size_t _LineNum)
+{
+	if (_Pos == _Tokens.size() || _Tokens[_Pos].Kind != PPTokenKind::Identifier)
+	{
+		Error(_LineNum, "#define expects a macro name.");
+		return false;
+	}
+
+	const std::string& Name = _Tokens[_Pos].Text;
+	if (Name == "defined" || Name == "__LINE__" || Name == "__FILE__")
+	{
+		Error(_LineNum, "'" + Name + "' cannot be defined.");
+		return false;
+	}
+
+	Macro NewMacro;
+	size_t Pos = _Pos + 1;
+
+	// Function-like only when the parenthesis follows the name right away.
+	if (Pos < _Tokens.size() && _Tokens[Pos].Text == "(")
+	{
+		NewMacro.IsFunction = true;
+		Pos = SkipBlanks(_Tokens, Pos + 1);
+		if (Pos < _Tokens.size() && _Tokens[Pos].Text == ")")
+		{
+			++Pos;
+		}
+		else
+		{
+			for (;;)
+			{
+				if (Pos < _Tokens.size() && _Tokens[Pos].Text == "...")
+				{
+					NewMacro.Params.push_back("__VA_ARGS__");
+					NewMacro.IsVariadic = true;
+				}
+				else if (Pos < _Tokens.size() && _Tokens[Pos].Kind == PPTokenKind::Identifier)
+				{
+					NewMacro.Params.push_back(_Tokens[Pos].Text);
+				}
+				else
+				{
+					Error(_LineNum, "bad parameter list for macro '" + Name + "'.");
+					return false;
+				}
+
+				Pos = SkipBlanks(_Tokens, Pos + 1);
+				if (Pos < _Tokens.size() && _Tokens[Pos].Text == ")" )
+				{
+					++Pos;
+					break;
+				}
+				if (NewMacro.IsVariadic || Pos == _Tokens.size() || _Tokens[Pos].Text != ",")
+				{
+					Error(_LineNum, "bad parameter list for macro '" + Name + "'.");
+					return false;
+				}
+				Pos = SkipBlanks(_Tokens, Pos + 1);
+			}
+		}
+	}
+
+	Pos = SkipBlanks(_Tokens, Pos);
+	size_t End = _Tokens.size();
+	while (End > Pos && IsBlank(_Tokens[End - 1]))
+		--End;
+	NewMacro.Body.assign(_Tokens.begin() + Pos, _Tokens.begin() + End);
+
+	if (!NewMacro.Body.empty() && (NewMacro.Body.front().Text == "##" || NewMacro.Body.back().Text == "##"))
+	{
+		Error(_LineNum, "'##' cannot be at either end of macro '" + Name + "'.");
+		return false;
+	}
+
+	const auto Previous = Macros.find(Name);
+	if (Previous != Macros.end())
+	{
+		const Macro& Old = Previous->second;
+		if (Old.IsFunction != NewMacro.IsFunction || Old.Params != NewMacro.Params || Spell(Old.Body) != Spell(NewMacro.Body))
+			Error(_LineNum, "macro '" + Name + "' redefined differently.");
+	}
+
+	Macros[Name] = std::move(NewMacro);
+	return true;
+}
+
+// The #include line stays in the output for the parser, which takes the included file from the queue when it
+// gets there. The included file is preprocessed right away, so that its macros apply to the rest of this file.
+void Preprocessor::Include(const std::vector<PPToken>& _Tokens, size_t _Pos, size_t _LineNum, std::string& _Out)
+{
+	std::vector<PPToken> Operand(_Tokens.begin() + _Pos, _Tokens.end());
+	if (!Operand.empty() && Operand[0].Kind == PPTokenKind::Identifier)
+	{
+		std::deque<PPToken> In(Operand.begin(), Operand.end());
+		Operand.clear();
+		Expand(In, Operand);
+	}
+
+	const std::string Spelling = Spell(Operand);
+	const bool IsAngle = !Spelling.empty() && Spelling[0] == '<';
+	const size_t Close = Spelling.find(IsAngle ? '>' : '"', 1);
+	if (Spelling.empty() || (Spelling[0] != '"' && !IsAngle) || Close == std::string::npos)
+	{
+		Error(_LineNum, "#include expects \"file\" or <file>.");
+		return;
+	}
+
+	if (FileStack.size() >= MaxIncludeDepth)
+	{
+		Error(_LineNum, "#include nested too deeply.");
+		return;
+	}
+
+	const std::string Filename = Spelling.substr(1, Close - 1);
+	const std::string Path = Host->FindInclude(Filename, FileStack.back(), IsAngle);
+
+	_Out += "#include " + Spelling.substr(0, Close + 1);
+	ProcessFile(Path);
+}
+
+// Reads the arguments of a function-like macro call, the name being already taken out of _In. _In is left
+// untouched unless the call is complete.
+Preprocessor::CallStatus Preprocessor::CollectArgs(std::deque<PPToken>& _In, std::vector<std::vector<PPToken>>& _Args, size_t& _NbNewlines)
+{
+	size_t Open = 0;
+	while (Open < _In.size() && IsBlank(_In[Open]))
+		++Open;
+	if (Open == _In.size())
+		return CallStatus::Incomplete;
+	if (_In[Open].Text != "(")
+		return CallStatus::NotACall;
+
+	size_t Close = Open + 1;
+	for (int Depth = 0; Close < _In.size(); Close++)
+	{
+		if (_In[Close].Text == "(")
+			++Depth;
+		else if (_In[Close].Text == ")" && Depth-- == 0)
+			break;
+	}
+	if (Close == _In.size())
+		return CallStatus::Incomplete;
+
+	_NbNewlines = 0;
+	_Args.assign(1, {});
+	int Depth = 0;
+	for (size_t i = 0; i < Close; i++)
+	{
+		PPToken& Token = _In[i];
+		if (Token.Kind == PPTokenKind::Newline)
+		{
+			++_NbNewlines;
+			Token.Kind = PPTokenKind::Space;
+			Token.Text = " ";
+		}
+		if (i <= Open)
+			continue;
+
+		if (Token.Text == "(")
+		{
+			++Depth;
+		}
+		else if (Token.Text == ")")
+		{
+			--Depth;
+		}
+		else if (Token.Text == "," && Depth == 0)
+		{
+			_Args.emplace_back();
+			continue;
+		}
+
+		if (!IsBlank(Token) || !_Args.back().empty())
+			_Args.back().push_back(std::move(Token));
+	}
+
+	for (auto& Arg : _Args)
+	{
+		while (!Arg.empty() && IsBlank(Arg.back()))
+			Arg.pop_back();
+	}
+
+	_In.erase(_In.begin(), _In.begin() + Close + 1);
+	return CallStatus::Complete;
+}
+
+std::vector<PPToken> Preprocessor::Substitute(const std::string& _Name, const Macro& _Macro, const std::vector<std::vector<PPToken>>& _Args, const PPToken& _NameToken)
+{
+	const std::vector<PPToken>& Body = _Macro.Body;
+
+	auto ParamIndex = [&](const PPToken& _Token) -> int
+	{
+		if (_Token.Kind != PPTokenKind::Identifier)
+			return -1;
+		for (size_t p = 0; p < _Macro.Params.size(); p++)
+		{
+			if (_Macro.Params[p] == _Token.Text)
+				return int(p);
+		}
+		return -1;
+	};
+
+	auto NextNonBlank = [&](size_t _Pos) { return SkipBlanks(Body, _Pos); };
+
+	std::vector<PPToken> Result;
+	bool IsPasting = false;		// The previous operator was ##, the next token sticks to the last one.
+
+	auto Append = [&](std::vector<PPToken> _Tokens)
+	{
+		if (IsPasting)
+		{
+			while (!Result.empty() && IsBlank(Result.back()))
+				Result.pop_back();
+			while (!_Tokens.empty() && IsBlank(_Tokens.front()))
+				_Tokens.erase(_Tokens.begin());
+
+			// An empty operand leaves the other one alone.
+			if (!Result.empty() && !_Tokens.empty())
+			{
+				std::vector<PPToken> Pasted;
+				Tokenize(Result.back().Text + _Tokens.front().Text, _NameToken.Line, Pasted);
+				if (Pasted.size() != 1)
+					Error(_NameToken.Line, "pasting \"" + Result.back().Text + "\" and \"" + _Tokens.front().Text + "\" does not give a valid token.");
+				Result.pop_back();
+				_Tokens.erase(_Tokens.begin());
+				Result.insert(Result.end(), Pasted.begin(), Pasted.end());
+			}
+			IsPasting = false;
+		}
+		Result.insert(Result.end(), _Tokens.begin(), _Tokens.end());
+	};
+
+	for (size_t i = 0; i < Body.size(); i++)
+	{
+		const PPToken& Token = Body[i];
+
+		if (Token.Text == "##" && Token.Kind == PPTokenKind::Punct)
+		{
+			IsPasting = true;
+			continue;
+		}
+		if (IsPasting && IsBlank(Token))
+			continue;
+
+		if (_Macro.IsFunction && Token.Text == "#" && Token.Kind == PPTokenKind::Punct)
+		{
+			const size_t Next = NextNonBlank(i + 1);
+			const int Param = Next < Body.size() ? ParamIndex(Body[Next]) : -1;
+			if (Param >= 0)
+			{
+				Append({ Stringize(_Args[Param], _NameToken.Line) });
+				i = Next;
+				continue;
+			}
+		}
+
+		const int Param = ParamIndex(Token);
+		if (Param < 0)
+		{
+			Append({ Token });
+			continue;
+		}
+
+		// Operands of ## are pasted as written, other arguments are fully expanded first.
+		const size_t Next = NextNonBlank(i + 1);
+		if (IsPasting || (Next < Body.size() && Body[Next].Text == "##"))
+		{
+			Append(_Args[Param]);
+		}
+		else
+		{
+			std::deque<PPToken> In(_Args[Param].begin(), _Args[Param].end());
+			std::vector<PPToken> Expanded;
+			Expand(In, Expanded);
+			Append(std::move(Expanded));
+		}
+	}
+
+	for (auto& Token : Result)
+	{
+		Token.Line = _NameToken.Line;
+		Token.HideSet.insert(Token.HideSet.end(), _NameToken.HideSet.begin(), _NameToken.HideSet.end());
+		Token.HideSet.push_back(_Name);
+	}
+	return Result;
+}
+
+// Takes tokens from the front of _In. A macro's replacement goes back to the front of _In, carrying the macro
+// in its hide set : it is rescanned along with the rest of the input, without the macro expanding again.
+// With _HasMore, a call whose arguments may continue past the end of _In stops the expansion : the call is
+// left in _In, for the caller to try again with more lines.
+void Preprocessor::Expand(std::deque<PPToken>& _In, std::vector<PPToken>& _Out, bool _HasMore)
+{
+	while (!_In.empty())
+	{
+		PPToken Token = std::move(_In.front());
+		_In.pop_front();
+
+		if (Token.Kind != PPTokenKind::Identifier || InHideSet(Token, Token.Text))
+		{
+			_Out.push_back(std::move(Token));
+			continue;
+		}
+
+		if (Token.Text == "__LINE__" || Token.Text == "__FILE__")
+		{
+			const bool IsLine = Token.Text == "__LINE__";
+			Token.Kind = IsLine ? PPTokenKind::Number : PPTokenKind::String;
+			if (IsLine)
+			{
+				Token.Text = std::to_string(Token.Line);
+			}
+			else
+			{
+				PPToken Name;
+				Name.Kind = PPTokenKind::Identifier;
+				Name.Text = FileStack.back();
+				Token.Text = Stringize({ Name }, Token.Line).Text;
+			}
+			_Out.push_back(std::move(Token));
+			continue;
+		}
+
+		const auto It = Macros.find(Token.Text);
+		if (It == Macros.end())
+		{
+			_Out.push_back(std::move(Token));
+			continue;
+		}
+
+		const Macro& Found = It->second;
+		std::vector<std::vector<PPToken>> Args;
+		size_t NbNewlines = 0;
+		if (Found.IsFunction)
+		{
+			const CallStatus Status = CollectArgs(_In, Args, NbNewlines);
+			if (Status == CallStatus::Incomplete && _HasMore)
+			{
+				_In.push_front(std::move(Token));
+				return;
+			}
+			if (Status == CallStatus::Incomplete && !std::all_of(_In.begin(), _In.end(), IsBlank))
+			{
+				Error(Token.Line, "unterminated call to macro '" + Token.Text + "'.");
+				_In.clear();
+				continue;
+			}
+			if (Status != CallStatus::Complete)
+			{
+				_Out.push_back(std::move(Token));
+				continue;
+			}
+
+			// f() is a call with no arguments, not with one empty argument.
+			if (Found.Params.empty() && Args.size() == 1 && SkipBlanks(Args[0], 0) == Args[0].size())
+				Args.clear();
+
+			if (Found.IsVariadic && Args.size() > Found.Params.size())
+			{
+				for (size_t a = Found.Params.size(); a < Args.size(); a++)
+				{
+					PPToken Comma, Space;
+					Comma.Text = ",";
+					Space.Kind = PPTokenKind::Space;
+					Space.Text = " ";
+					Args[Found.Params.size() - 1].push_back(std::move(Comma));
+					Args[Found.Params.size() - 1].push_back(std::move(Space));
+					Args[Found.Params.size() - 1].insert(Args[Found.Params.size() - 1].end(), Args[a].begin(), Args[a].end());
+				}
+				Args.resize(Found.Params.size());
+			}
+			else if (Found.IsVariadic && Args.size() + 1 == Found.Params.size())
+			{
+				Args.emplace_back();
+			}
+
+			if (Args.size() != Found.Params.size())
+			{
+				Error(Token.Line, "macro '" + Token.Text + "' takes " + std::to_string(Found.Params.size()) + " arguments, " + std::to_string(Args.size()) + " given.");
+				continue;
+			}
+		}
+
+		// Lines the call spanned come back after the replacement, so that the following lines keep their number.
+		for (size_t l = 0; l < NbNewlines; l++)
+		{
+			PPToken Newline;
+			Newline.Kind = PPTokenKind::Newline;
+			Newline.Text = "\n";
+			_In.push_front(std::move(Newline));
+		}
+
+		std::vector<PPToken> Replacement = Substitute(It->first, Found, Args, Token);
+		_In.insert(_In.begin(), std::make_move_iterator(Replacement.begin()), std::make_move_iterator(Replacement.end()));
+	}
+}
+
+namespace
+{
+	// Integer constant expressions of #if and #elif, on tokens already macro-expanded. Additions, subtractions,
+	// products and left shifts wrap around like unsigned ones do; shifts by a negative amount or by 64 and more,
+	// and the divisions that overflow, make the expression invalid.
+	struct ConditionParser
+	{
+		std::vector<PPToken> Tokens;		// Blanks removed.
+		size_t Pos = 0;
+		bool IsValid = true;
+
+		const std::string& Peek() const
+		{
+			static const std::string End;
+			return Pos < Tokens.size() ? Tokens[Pos].Text : End;
+		}
+
+		bool Accept(const char* _Text)
+		{
+			if (Peek() != _Text)
+				return false;
+			++Pos;
+			return true;
+		}
+
+		void Expect(const char* _Text)
+		{
+			if (!Accept(_Text))
+				IsValid = false;
+		}
+
+		long long Primary()
+		{
+			if (Pos == Tokens.size())
+			{
+				IsValid = false;
+				return 0;
+			}
+
+			const PPToken& Token = Tokens[Pos++];
+			if (Token.Text == "(")
+			{
+				const long long Value = Conditional();
+				Expect(")");
+				return Value;
+			}
+			if (Token.Kind == PPTokenKind::Number)
+			{
+				char* End = nullptr;
+				const long long Value = strtoll(Token.Text.c_str(), &End, 0);
+				if (strspn(End, "uUlL") != strlen(End))
+					IsValid = false;
+				return Value;
+			}
+			if (Token.Kind == PPTokenKind::String && Token.Text.size() >= 3 && Token.Text[0] == '\'')
+			{
+				if (Token.Text[1] != '\\')
+					return (unsigned char)Token.Text[1];
+
+				switch (Token.Text[2])
+				{
+				case 'n': return '\n';
+				case 't': return '\t';
+				case 'r': return '\r';
+				case '0': return 0;
+				default: return (unsigned char)Token.Text[2];
+				}
+			}
+			if (Token.Kind == PPTokenKind::Identifier)
+				return Token.Text == "true" ? 1 : 0;		// Names left after expansion count as 0.
+
+			IsValid = false;
+			return 0;
+		}
+
+		long long Unary()
+		{
+			if (Accept("!")) return !Unary();
+			if (Accept("~")) return ~Unary();
+			if (Accept("-")) return (long long)(0ull - (unsigned long long)Unary());
+			if (Accept("+")) return Unary();
+			return Primary();
+		}
+
+		long long Multiplicative()
+		{
+			long long Value = Unary();
+			for (;;)
+			{
+				if (Accept("*"))
+				{
+					Value = (long long)((unsigned long long)Value * (unsigned long long)Unary());
+				}
+				else if (Peek() == "/" || Peek() == "%")
+				{
+					const bool IsDiv = Tokens[Pos++].Text == "/";
+					const long long Rhs = Unary();
+					if (Rhs == 0 || (Value == LLONG_MIN && Rhs == -1))
+						IsValid = false;
+					else
+						Value = IsDiv ? Value / Rhs : Value % Rhs;
+				}
+				else
+				{
+					return Value;
+				}
+			}
+		}
+
+		long long Additive()
+		{
+			long long Value = Multiplicative();
+			for (;;)
+			{
+				if (Accept("+")) Value = (long long)((unsigned long long)Value + (unsigned long long)Multiplicative());
+				else if (Accept("-")) Value = (long long)((unsigned long long)Value - (unsigned long long)Multiplicative());
+				else return Value;
+			}
+		}
+
+		long long Shift()
+		{
+			long long Value = Additive();
+			for (;;)
+			{
+				const bool IsLeft = Peek() == "<<";
+				if (!IsLeft && Peek() != ">>")
+					return Value;
+
+				++Pos;
+				const long long Rhs = Additive();
+				if (Rhs < 0 || Rhs >= 64)
+					IsValid = false;
+				else
+					Value = IsLeft ? (long long)((unsigned long long)Value << Rhs) : Value >> Rhs;
+			}
+		}
+
+		long long Relational()
+		{
+			long long Value = Shift();
+			for (;;)
+			{
+				if (Accept("<")) Value = Value < Shift();
+				else if (Accept(">")) Value = Value > Shift();
+				else if (Accept("<=")) Value = Value <= Shift();
+				else if (Accept(">=")) Value = Value >= Shift();
+				else return Value;
+			}
+		}
+
+		long long Equality()
+		{
+			long long Value = Relational();
+			for (;;)
+			{
+				if (Accept("==")) Value = Value == Relational();
+				else if (Accept("!=")) Value = Value != Relational();
+				else return Value;
+			}
+		}
+
+		long long BitAnd()
+		{
+			long long Value = Equality();
+			while (Accept("&"))
+				Value &= Equality();
+			return Value;
+		}
+
+		long long BitXor()
+		{
+			long long Value = BitAnd();
+			while (Accept("^"))
+				Value ^= BitAnd();
+			return Value;
+		}
+
+		long long BitOr()
+		{
+			long long Value = BitXor();
+			while (Accept("|"))
+				Value |= BitXor();
+			return Value;
+		}
+
+		long long LogicalAnd()
+		{
+			long long Value = BitOr();
+			while (Accept("&&"))
+			{
+				const long long Rhs = BitOr();
+				Value = Value && Rhs;
+			}
+			return Value;
+		}
+
+		long long LogicalOr()
+		{
+			long long Value = LogicalAnd();
+			while (Accept("||"))
+			{
+				const long long Rhs = LogicalAnd();
+				Value = Value || Rhs;
+			}
+			return Value;
+		}
+
+		long long Conditional()
+		{
+			const long long Cond = LogicalOr();
+			if (!Accept("?"))
+				return Cond;
+
+			const long long IfTrue = Conditional();
+			Expect(":");
+			const long long IfFalse = Conditional();
+			return Cond ? IfTrue : IfFalse;
+		}
+	};
+}
+
+bool Preprocessor::EvalCondition(const std::vector<PPToken>& _Tokens, size_t _Pos, size_t _LineNum)
+{
+	// defined is resolved before expansion, so that it sees the names as written.
+	std::deque<PPToken> In;
+	for (size_t i = _Pos; i < _Tokens.size(); i++)
+	{
+		if (_Tokens[i].Text != "defined")
+		{
+			In.push_back(_Tokens[i]);
+			continue;
+		}
+
+		size_t Next = SkipBlanks(_Tokens, i + 1);
+		const bool HasParen = Next < _Tokens.size() && _Tokens[Next].Text == "(";
+		if (HasParen)
+			Next = SkipBlanks(_Tokens, Next + 1);
+		if (Next == _Tokens.size() || _Tokens[Next].Kind != PPTokenKind::Identifier)
+		{
+			Error(_LineNum, "'defined' expects a macro name.");
+			return false;
+		}
+
+		PPToken Value;
+		Value.Kind = PPTokenKind::Number;
+		Value.Text = Macros.count(_Tokens[Next].Text) ? "1" : "0";
+		In.push_back(std::move(Value));
+
+		if (HasParen)
+		{
+			Next = SkipBlanks(_Tokens, Next + 1);
+			if (Next == _Tokens.size() || _Tokens[Next].Text != ")")
+			{
+				Error(_LineNum, "missing ')' after 'defined'.");
+				return false;
+			}
+		}
+		i = Next;
+	}
+
+	std::vector<PPToken> Expanded;
+	Expand(In, Expanded);
+
+	ConditionParser Parser;
+	for (auto& Token : Expanded)
+	{
+		if (!IsBlank(Token))
+			Parser.Tokens.push_back(std::move(Token));
+	}
+
+	const long long Value = Parser.Conditional();
+	if (!Parser.IsValid || Parser.Pos != Parser.Tokens.size())
+	{
+		Error(_LineNum, "invalid #if expression.");
+		return false;
+	}
+	return Value != 0;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <functional>
+
+namespace DevonC
+{
+	enum class PPTokenKind : unsigned char
+	{
+		Identifier,
+		Number,
+		String,			// String and character literals.
+		Punct,
+		Space,
+		Newline,
+	};
+
+	struct PPToken
+	{
+		PPTokenKind Kind = PPTokenKind::Punct;
+		std::string Text;
+		size_t Line = 0;
+		std::vector<std::string> HideSet;		// Macros this token came out of : they do not expand it again.
+	};
+
+	struct Macro
+	{
+		std::vector<PPToken> Body;
+		std::vector<std::string> Params;
+		bool IsFunction = false;
+		bool IsVariadic = false;		// The last parameter is __VA_ARGS__.
+	};
+
+	struct PreprocessedFile
+	{
+		std::string Path;
+		std::string Text;
+		std::string Error;		// Set when the file could not be read.
+	};
+
+	// What the preprocessor needs from the compiler.
+	struct PreprocessorHost
+	{
+		std::function<std::string(const std::string& _Path)> Load;		// Comment-free source, throws when the file cannot be read.
+		std::function<std::string(const std::string& _Filename, const std::string& _Includer, bool _IsAngle)> FindInclude;
+		std::function<void(const std::string& _Path, size_t _Line, const std::string& _Message)> Error;
+	};
+
+	// Runs the directives of a translation unit and expands its macros. Every file comes out as its own text, in
+	// the order the parser includes them, with the same number of lines as the source : directives become blank
+	// lines, except #include which stays for the parser, and skipped regions are blank as well.
+	// Macros are expanded on tokens, each carrying the set of macros it came out of, so that the result of an
+	// expansion is rescanned without going back to text.
+	class Preprocessor
+	{
+		enum class CallStatus : unsigned char
+		{
+			Complete,
+			NotACall,		// The name is not followed by a parenthesis.
+			Incomplete,		// The input ends before the call does.
+		};
+
+		struct Conditional
+		{
+			bool IsActive;
+			bool WasTaken;		// A branch was taken already, or the whole #if is in a skipped region.
+			bool HasElse;
+			size_t Line;
+		};
+
+		std::unordered_map<std::string, Macro> Macros;
+		const PreprocessorHost* Host = nullptr;
+		std::deque<PreprocessedFile>* Files = nullptr;
+		std::vector<std::string> FileStack;
+
+		void Error(size_t _Line, const std::string& _Message);
+		void ProcessFile(const std::string& _Path);
+		void Directive(const std::string& _Line, size_t _LineNum, std::vector<Conditional>& _Conds, std::string& _Out);
+		bool DefineMacro(const std::vector<PPToken>& _Tokens, size_t _Pos, size_t _LineNum);
+		void Include(const std::vector<PPToken>& _Tokens, size_t _Pos, size_t _LineNum, std::string& _Out);
+		bool EvalCondition(const std::vector<PPToken>& _Tokens, size_t _Pos, size_t _LineNum);
+		bool HasMacros(const std::string& _Line) const;
+		void Expand(std::deque<PPToken>& _In, std::vector<PPToken>& _Out, bool _HasMore = false);
+		CallStatus CollectArgs(std::deque<PPToken>& _In, std::vector<std::vector<PPToken>>& _Args, size_t& _NbNewlines);
+		std::vector<PPToken> Substitute(const std::string& _Name, const Macro& _Macro, const std::vector<std::vector<PPToken>>& _Args, const PPToken& _NameToken);
+
+	public:
+		bool Define(const std::string& _Definition);		// "NAME" or "NAME=VALUE", as given with -D.
+		void Run(const std::string& _Path, const PreprocessorHost& _Host, std::deque<PreprocessedFile>& _Files);
+	};
+}
@@ -0,0 +1,612 @@
+#include "Simulator.h"
+#include "Linker.h"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdio>
+#include <cstring>
+#include <climits>
+#include <algorithm>
+
+using namespace DevonC;
+
+struct OpcodeInfo
+{
+	const char* Name;
+	OpClass Class;
+	int Cycles;
+};
+
+// Base costs. A taken branch costs one more cycle, so does every memory access outside the
+// short-address window and every 32-bit access, which takes two trips on the 16-bit bus.
+static const OpcodeInfo Opcodes[] =
+{
+	{ "ld",		OpClass::Load,		2 },
+	{ "st",		OpClass::Store,		2 },
+	{ "mov",	OpClass::Move,		1 },
+	{ "add",	OpClass::Alu,		1 },
+	{ "sub",	OpClass::Alu,		1 },
+	{ "and",	OpClass::Alu,		1 },
+	{ "or",		OpClass::Alu,		1 },
+	{ "xor",	OpClass::Alu,		1 },
+	{ "shl",	OpClass::Alu,		1 },
+	{ "shr",	OpClass::Alu,		1 },
+	{ "neg",	OpClass::Alu,		1 },
+	{ "not",	OpClass::Alu,		1 },
+	{ "mul",	OpClass::Alu,		4 },
+	{ "div",	OpClass::Alu,		16 },
+	{ "mod",	OpClass::Alu,		16 },
+	{ "cmp",	OpClass::Compare,	1 },
+	{ "jmp",	OpClass::Jump,		2 },
+	{ "beq",	OpClass::Branch,	1 },
+	{ "bne",	OpClass::Branch,	1 },
+	{ "blt",	OpClass::Branch,	1 },
+	{ "ble",	OpClass::Branch,	1 },
+	{ "bgt",	OpClass::Branch,	1 },
+	{ "bge",	OpClass::Branch,	1 },
+	{ "call",	OpClass::Call,		3 },
+	{ "ret",	OpClass::Return,	3 },
+};
+
+static const char* ClassNames[] = { "label", "load", "store", "move", "alu", "compare", "jump", "branch", "call", "return" };
+
+static const OpcodeInfo* FindOpcode(const std::string& _Opcode)
+{
+	const std::string Base = _Opcode.substr(0, _Opcode.find('.'));
+	for (const auto& Info : Opcodes)
+		if (Base == Info.Name)
+			return &Info;
+
+	return nullptr;
+}
+
+// ".b" : 8 bits, ".l" : 32 bits, 16 bits otherwise.
+static int AccessSize(const std::string& _Opcode)
+{
+	const size_t Dot = _Opcode.find('.');
+	if (Dot == std::string::npos || Dot + 1 >= _Opcode.size())
+		return 2;
+
+	return _Opcode[Dot + 1] == 'b' ? 1 : _Opcode[Dot + 1] == 'l' ? 4 : 2;
+}
+
+static std::string Trim(const std::string& _Str)
+{
+	const size_t Begin = _Str.find_first_not_of(" \t\r");
+	if (Begin == std::string::npos)
+		return "";
+
+	return _Str.substr(Begin, _Str.find_last_not_of(" \t\r") - Begin + 1);
+}
+
+static bool ParseNumber(const std::string& _Str, long long& _Value)
+{
+	if (_Str.empty() || !(isdigit((unsigned char)_Str[0]) || ((_Str[0] == '-' || _Str[0] == '+') && _Str.size() > 1)))
+		return false;
+
+	char* End = nullptr;
+	_Value = strtoll(_Str.c_str(), &End, 0);
+	return *End == '\0';
+}
+
+static std::string InstrText(const Instruction& _Instr)
+{
+	return _Instr.Opcode + (_Instr.Dst.empty() ? "" : " " + _Instr.Dst) + (_Instr.Src.empty() ? "" : ", " + _Instr.Src);
+}
+
+bool Simulator::Fail(const std::string& _Error)
+{
+	Error = _Error;
+	return false;
+}
+
+// Reads back what Compiler::WriteListing writes : code first, then the object's sections, symbols and relocations.
+bool Simulator::ParseListing(std::istream& _In, Object& _Obj)
+{
+	static const char* RelocNames[] = { "none", "abs16", "abs32", "rel16" };
+
+	bool IsData = false;
+	int CurSection = -1;
+	int LineNum = 0;
+	std::string Line;
+	while (std::getline(_In, Line))
+	{
+		LineNum++;
+		const std::string Where = "line " + std::to_string(LineNum) + " : ";
+		if (!Line.empty() && Line.back() == '\r')
+			Line.pop_back();
+		if (Trim(Line).empty() || Line[0] == ';')
+			continue;
+
+		// Labels, or symbols in the data part.
+		if (Line[0] != '\t' && Line[0] != ' ')
+		{
+			const size_t Colon = Line.find(':');
+			if (Colon == std::string::npos)
+				return Fail(Where + "expected a label");
+
+			const std::string Name = Line.substr(0, Colon);
+			if (!IsData)
+			{
+				Labels[Name] = Code.size();
+				Code.emplace_back(OpClass::Label, "", Name);
+				continue;
+			}
+
+			unsigned int Offset = 0, Size = 0;
+			if (CurSection < 0 || sscanf(Line.c_str() + Colon + 1, " ; +%u, %u", &Offset, &Size) != 2)
+				return Fail(Where + "bad symbol");
+
+			ObjSymbol& Symbol = _Obj.Symbols[_Obj.AddSymbol(Name)];
+			Symbol.Section = CurSection;
+			Symbol.Offset = Offset;
+			Symbol.Size = Size;
+			Symbol.IsLocal = Line.find(", local", Colon) != std::string::npos;
+			Symbol.IsFunction = _Obj.Sections[CurSection].Name.compare(0, 5, ".text") == 0;
+			continue;
+		}
+
+		std::istringstream Fields(Line);
+		std::string Opcode, Operands;
+		Fields >> Opcode;
+		std::getline(Fields, Operands);
+		Operands = Trim(Operands);
+
+		const size_t Comma = Operands.find(',');
+		const std::string First = Trim(Operands.substr(0, Comma));
+		const std::string Rest = Comma == std::string::npos ? "" : Trim(Operands.substr(Comma + 1));
+
+		if (Opcode == ".section")
+		{
+			int Align = 1;
+			unsigned int Size = 0;
+			if (sscanf(Rest.c_str(), "align %d, %u", &Align, &Size) != 2)
+				return Fail(Where + "bad section");
+
+			IsData = true;
+			CurSection = _Obj.AddSection(First, Align, First.compare(0, 4, ".bss") == 0);
+			if (_Obj.Sections[CurSection].IsBss)
+				_Obj.Sections[CurSection].BssSize = Size;
+		}
+		else if (Opcode == ".byte")
+		{
+			std::istringstream Bytes(Operands);
+			std::string Byte;
+			long long Value = 0;
+			while (std::getline(Bytes, Byte, ','))
+			{
+				if (CurSection < 0 || !ParseNumber(Trim(Byte), Value))
+					return Fail(Where + "bad data");
+				_Obj.Sections[CurSection].Data.push_back((unsigned char)Value);
+			}
+		}
+		else if (Opcode == ".extern")
+		{
+			_Obj.AddSymbol(Operands);
+		}
+		else if (Opcode == ".reloc")
+		{
+			// .reloc section+offset, type, symbol
+			const size_t Plus = First.rfind('+');
+			const size_t TypeEnd = Rest.find(',');
+			long long Offset = 0;
+			int Section = -1, Type = -1;
+			for (int s = 0; s < int(_Obj.Sections.size()); s++)
+				if (Plus != std::string::npos && _Obj.Sections[s].Name == First.substr(0, Plus))
+					Section = s;
+			for (int t = 0; t < 4 && TypeEnd != std::string::npos; t++)
+				if (Trim(Rest.substr(0, TypeEnd)) == RelocNames[t])
+					Type = t;
+
+			if (Section < 0 || Type < 0 || !ParseNumber(First.substr(Plus + 1), Offset))
+				return Fail(Where + "bad relocation");
+
+			_Obj.AddRelocation(Section, (unsigned int)Offset, _Obj.AddSymbol(Trim(Rest.substr(TypeEnd + 1))), RelocType(Type));
+		}
+		else if (IsData || Opcode[0] == '.')
+		{
+			return Fail(Where + "unexpected " + Opcode);
+		}
+		else
+		{
+			const OpcodeInfo* Info = FindOpcode(Opcode);
+			if (Info == nullptr)
+				return Fail(Where + "unknown instruction " + Opcode);
+
+			Code.emplace_back(Info->Class, Opcode, First, Rest);
+		}
+	}
+
+	return true;
+}
+
+bool Simulator::LoadListing(const std::string& _Filename)
+{
+	std::ifstream File(_Filename);
+	if (!File)
+		return Fail("cannot read \"" + _Filename + "\"");
+
+	return LoadListing(File, _Filename);
+}
+
+bool Simulator::LoadListing(std::istream& _In, const std::string& _Name)
+{
+	Object Obj;
+	if (!ParseListing(_In, Obj))
+		return false;
+
+	Memory.assign(0x10000, 0);
+
+	// Hand-written listings may have no data at all.
+	if (Obj.Sections.empty())
+		return true;
+
+	const std::vector<ObjSymbol> SymbolInfos = Obj.Symbols;
+
+	Linker Link;
+	Link.AddObject(std::move(Obj), _Name);
+	if (!Link.Link())
+		return Fail("link failed");
+
+	const auto& Image = Link.GetImage();
+	if (Image.size() > Memory.size())
+		return Fail("the image does not fit in memory");
+	std::copy(Image.begin(), Image.end(), Memory.begin());
+
+	for (const auto& Symbol : SymbolInfos)
+	{
+		unsigned int Address = 0;
+		if (!Link.FindSymbolAddress(Symbol.Name, Address))
+			continue;
+
+		Symbols[Symbol.Name] = Address;
+		if (!Symbol.IsFunction && Symbol.Section >= 0)
+			DataSymbols.push_back({ Symbol.Name, Address, Symbol.Size });
+	}
+
+	std::sort(DataSymbols.begin(), DataSymbols.end(), [](const DataSymbol& _A, const DataSymbol& _B) { return _A.Address < _B.Address; });
+
+	return true;
+}
+
+int* Simulator::Register(const std::string& _Operand)
+{
+	if (_Operand.size() != 2 || _Operand[0] != 'r' || _Operand[1] < '0' || _Operand[1] >= '0' + NbRegisters)
+		return nullptr;
+
+	return &Registers[_Operand[1] - '0'];
+}
+
+// rN, #number or #symbol for its address.
+bool Simulator::Value(const std::string& _Operand, int& _Value)
+{
+	if (const int* Reg = Register(_Operand))
+	{
+		_Value = *Reg;
+		return true;
+	}
+
+	if (_Operand.empty() || _Operand[0] != '#')
+		return false;
+
+	long long Number = 0;
+	if (ParseNumber(_Operand.substr(1), Number))
+	{
+		_Value = int(Number);
+		return true;
+	}
+
+	const auto Symbol = Symbols.find(_Operand.substr(1));
+	if (Symbol == Symbols.end())
+		return false;
+
+	_Value = int(Symbol->second);
+	return true;
+}
+
+// [term+term...], each term being a register, a number or a symbol.
+bool Simulator::Address(const std::string& _Operand, unsigned int& _Address)
+{
+	if (_Operand.size() < 3 || _Operand.front() != '[' || _Operand.back() != ']')
+		return false;
+
+	std::istringstream Terms(_Operand.substr(1, _Operand.size() - 2));
+	std::string Term;
+	long long Sum = 0;
+	while (std::getline(Terms, Term, '+'))
+	{
+		Term = Trim(Term);
+		long long Number = 0;
+		if (const int* Reg = Register(Term))
+			Sum += *Reg;
+		else if (ParseNumber(Term, Number))
+			Sum += Number;
+		else if (Symbols.count(Term) > 0)
+			Sum += Symbols[Term];
+		else
+			return false;
+	}
+
+	_Address = (unsigned int)Sum;
+	return true;
+}
+
+bool Simulator::Access(const Instruction& _Instr, unsigned int _Address, int _Size)
+{
+	// In size_t, where an address near the top of the 32-bit range cannot wrap past the check.
+	if (size_t(_Size) > Memory.size() || _Address > Memory.size() - size_t(_Size))
+		return Fail("out of memory access : " + InstrText(_Instr));
+
+	auto Symbol = std::upper_bound(DataSymbols.begin(), DataSymbols.end(), _Address, [](unsigned int _Addr, const DataSymbol& _Symbol) { return _Addr < _Symbol.Address; });
+	if (Symbol != DataSymbols.begin() && _Address < (--Symbol)->Address + Symbol->Size)
+		GlobalCounts[Symbol->Name]++;
+
+	if (_Address < ShortAddressWindow)
+		NbShortAccesses++;
+	else
+		Cycles++;
+
+	if (_Size > 2)
+		Cycles++;
+
+	return true;
+}
+
+bool Simulator::Step(size_t& _PC, bool& _IsDone)
+{
+	if (_PC >= Code.size())
+		return Fail("ran past the end of the code");
+
+	const Instruction& Instr = Code[_PC++];
+	if (Instr.Class == OpClass::Label)
+	{
+		EnterBlock(_PC - 1);
+		return true;
+	}
+
+	const OpcodeInfo* Info = FindOpcode(Instr.Opcode);
+	const std::string Base = Info->Name;
+	const int Size = AccessSize(Instr.Opcode);
+
+	NbInstructions++;
+	ClassCounts[int(Instr.Class)]++;
+	OpcodeCounts[Instr.Opcode]++;
+	Cycles += Info->Cycles;
+
+	const std::string Bad = "bad operands : " + InstrText(Instr);
+
+	switch (Instr.Class)
+	{
+	case OpClass::Load:
+	{
+		int* Dst = Register(Instr.Dst);
+		unsigned int Addr = 0;
+		if (Dst == nullptr || !Address(Instr.Src, Addr))
+			return Fail(Bad);
+		if (!Access(Instr, Addr, Size))
+			return false;
+
+		unsigned int Value = 0;
+		for (int i = 0; i < Size; i++)
+			Value |= (unsigned int)Memory[Addr + i] << (8 * i);
+
+		// Narrow loads are sign-extended.
+		*Dst = Size == 1 ? int((signed char)Value) : Size == 2 ? int((short)Value) : int(Value);
+		NbLoads++;
+		LoadBytes += Size;
+		break;
+	}
+
+	case OpClass::Store:
+	{
+		unsigned int Addr = 0;
+		int Value = 0;
+		if (!Address(Instr.Dst, Addr) || !this->Value(Instr.Src, Value))
+			return Fail(Bad);
+		if (!Access(Instr, Addr, Size))
+			return false;
+
+		for (int i = 0; i < Size; i++)
+			Memory[Addr + i] = (unsigned char)((unsigned int)Value >> (8 * i));
+		NbStores++;
+		StoreBytes += Size;
+		break;
+	}
+
+	case OpClass::Move:
+	{
+		int* Dst = Register(Instr.Dst);
+		if (Dst == nullptr || !Value(Instr.Src, *Dst))
+			return Fail(Bad);
+		break;
+	}
+
+	case OpClass::Alu:
+	{
+		int* Dst = Register(Instr.Dst);
+		int Src = 0;
+		if (Dst == nullptr || (!Instr.Src.empty() && !Value(Instr.Src, Src)))
+			return Fail(Bad);
+
+		// Unary operations work in place when there is no source.
+		if (Instr.Src.empty())
+			Src = *Dst;
+
+		const unsigned int A = (unsigned int)*Dst, B = (unsigned int)Src;
+		if ((Base == "div" || Base == "mod") && B == 0)
+			return Fail("division by zero : " + InstrText(Instr));
+		if ((Base == "div" || Base == "mod") && *Dst == INT_MIN && Src == -1)
+			return Fail("division overflow : " + InstrText(Instr));
+
+		if (Base == "add")		*Dst = int(A + B);
+		else if (Base == "sub")	*Dst = int(A - B);
+		else if (Base == "and")	*Dst = int(A & B);
+		else if (Base == "or")	*Dst = int(A | B);
+		else if (Base == "xor")	*Dst = int(A ^ B);
+		else if (Base == "shl")	*Dst = int(A << (B & 31));
+		else if (Base == "shr")	*Dst = *Dst >> (B & 31);
+		else if (Base == "neg")	*Dst = int(0u - B);
+		else if (Base == "not")	*Dst = int(~B);
+		else if (Base == "mul")	*Dst = int(A * B);
+		else if (Base == "div")	*Dst = *Dst / Src;
+		else if (Base == "mod")	*Dst = *Dst % Src;
+
+		Flags = *Dst;
+		break;
+	}
+
+	case OpClass::Compare:
+	{
+		int A = 0, B = 0;
+		if (!Value(Instr.Dst, A) || !Value(Instr.Src, B))
+			return Fail(Bad);
+
+		Flags = (long long)A - B;
+		break;
+	}
+
+	case OpClass::Branch:
+	case OpClass::Jump:
+	{
+		const auto Target = Labels.find(Instr.Dst);
+		if (Target == Labels.end())
+			return Fail("unknown label : " + InstrText(Instr));
+
+		const bool IsTaken = Base == "jmp"
+			|| (Base == "beq" && Flags == 0) || (Base == "bne" && Flags != 0)
+			|| (Base == "blt" && Flags < 0) || (Base == "ble" && Flags <= 0)
+			|| (Base == "bgt" && Flags > 0) || (Base == "bge" && Flags >= 0);
+
+		if (IsTaken)
+		{
+			_PC = Target->second;
+			if (Instr.Class == OpClass::Branch)
+				Cycles++;
+		}
+		break;
+	}
+
+	case OpClass::Call:
+	{
+		if (Instr.Dst == "__host_print")
+			std::cout << Registers[0] << std::endl;
+		else if (Instr.Dst == "__host_putc")
+			std::cout << char(Registers[0]);
+		else if (Instr.Dst == "__host_exit")
+		{
+			ExitCode = Registers[0];
+			_IsDone = true;
+		}
+		else if (IsHostFunction(Instr.Dst))
+			return Fail("unknown host function : " + InstrText(Instr));
+		else
+		{
+			const auto Target = Labels.find(Instr.Dst);
+			if (Target == Labels.end())
+				return Fail("unknown function : " + InstrText(Instr));
+
+			if (CallStack.size() >= MaxCallDepth)
+				return Fail("call stack overflow : " + InstrText(Instr));
+
+			CallStack.push_back({ _PC, CurBlock });
+			CallCounts[Target->second]++;
+			_PC = Target->second;
+		}
+		break;
+	}
+
+	case OpClass::Return:
+		// Returning from the entry point ends the program, with r0 as exit code.
+		if (CallStack.empty())
+		{
+			ExitCode = Registers[0];
+			_IsDone = true;
+		}
+		else
+		{
+			_PC = CallStack.back().ReturnPC;
+			CurBlock = CallStack.back().Block;
+			CallStack.pop_back();
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	return true;
+}
+
+// Edges are counted between labels : from the one last passed to the one reached, through a jump,
+// a taken branch, a call or by falling through.
+void Simulator::EnterBlock(size_t _Label)
+{
+	BlockCounts[_Label]++;
+	if (CurBlock != SIZE_MAX)
+		EdgeCounts[{ CurBlock, _Label }]++;
+
+	CurBlock = _Label;
+}
+
+bool Simulator::Run(const std::string& _Entry, long long _MaxCycles)
+{
+	const auto Entry = Labels.find(_Entry);
+	if (Entry == Labels.end())
+		return Fail("no entry point '" + _Entry + "'");
+
+	size_t PC = Entry->second;
+	CallCounts[PC]++;
+	bool IsDone = false;
+	while (!IsDone)
+	{
+		if (Cycles > _MaxCycles)
+			return Fail("cycle limit reached");
+		if (!Step(PC, IsDone))
+			return false;
+	}
+
+	return true;
+}
+
+void Simulator::DumpStats(std::ostream& _Out) const
+{
+	_Out << "\nCycles : " << Cycles << "\n";
+	_Out << "Instructions : " << NbInstructions << "\n";
+
+	for (int c = int(OpClass::Load); c <= int(OpClass::Return); c++)
+	{
+		if (ClassCounts[c] == 0)
+			continue;
+
+		_Out << "\t" << ClassNames[c] << " : " << ClassCounts[c] << " (" << std::fixed << std::setprecision(1)
+			<< 100.0 * ClassCounts[c] / NbInstructions << "%)\n" << std::defaultfloat;
+		for (const auto& Opcode : OpcodeCounts)
+			if (FindOpcode(Opcode.first)->Class == OpClass(c))
+				_Out << "\t\t" << Opcode.first << " : " << Opcode.second << "\n";
+	}
+
+	_Out << "Memory : " << NbLoads << " load" << (NbLoads != 1 ? "s" : "") << " (" << LoadBytes << " bytes), "
+		<< NbStores << " store" << (NbStores != 1 ? "s" : "") << " (" << StoreBytes << " bytes), "
+		<< NbShortAccesses << " in the short-address window\n";
+}
+
+// One record per line, see Compiler::LoadProfile().
+bool Simulator::WriteProfile(const std::string& _Filename) const
+{
+	std::ofstream Profile(_Filename);
+	if (!Profile)
+		return false;
+
+	Profile << "# DevonC profile\n";
+	for (const auto& Global : GlobalCounts)
+		Profile << "global " << Global.first << " " << Global.second << "\n";
+	for (const auto& Block : BlockCounts)
+		Profile << "block " << Code[Block.first].Dst << " " << Block.second << "\n";
+	for (const auto& Call : CallCounts)
+		Profile << "call " << Code[Call.first].Dst << " " << Call.second << "\n";
+	for (const auto& Edge : EdgeCounts)
+		Profile << "edge " << Code[Edge.first.first].Dst << " " << Code[Edge.first.second].Dst << " " << Edge.second << "\n";
+
+	return bool(Profile);
+}
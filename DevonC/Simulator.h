@@ -0,0 +1,88 @@
+#pragma once
+
+#include "Devon16.h"
+#include "Object.h"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <iostream>
+
+namespace DevonC
+{
+	// Runs Devon16 code in the symbolic form the compiler lists with -S, against 64KB of memory holding
+	// the linked data. Registers r0 to r7 hold 32-bit values, return addresses are kept aside from memory.
+	// Programs reach the host by calling __host_print (prints r0), __host_putc (writes r0 as a character)
+	// and __host_exit (stops with r0 as exit code).
+	// Cycle counts come from the cost table in Simulator.cpp : they compare code generation choices,
+	// they are not a measurement of the hardware.
+	// Every run also counts how often each label is reached and from where, how often each function is
+	// called and how often each global is accessed : WriteProfile() saves those counts for -fprofile-use.
+	class Simulator
+	{
+	public:
+		static constexpr int NbRegisters = 8;
+
+	private:
+		struct DataSymbol
+		{
+			std::string Name;
+			unsigned int Address;
+			unsigned int Size;
+		};
+
+		struct Frame
+		{
+			size_t ReturnPC;
+			size_t Block;
+		};
+
+		InstructionList Code;
+		std::unordered_map<std::string, size_t> Labels;
+		std::unordered_map<std::string, unsigned int> Symbols;
+		std::vector<DataSymbol> DataSymbols;	// Sorted by address.
+		std::vector<unsigned char> Memory;
+		std::vector<Frame> CallStack;
+		static constexpr size_t MaxCallDepth = 1 << 16;	// Deeper is taken for runaway recursion.
+		size_t CurBlock = SIZE_MAX;				// Last label passed.
+		int Registers[NbRegisters] = {};
+		long long Flags = 0;			// Difference of the last compare, or result of the last ALU operation.
+		int ExitCode = 0;
+		std::string Error;
+
+		long long Cycles = 0;
+		long long NbInstructions = 0;
+		long long ClassCounts[int(OpClass::Return) + 1] = {};
+		std::map<std::string, long long> OpcodeCounts;
+		long long NbLoads = 0, NbStores = 0;
+		long long LoadBytes = 0, StoreBytes = 0;
+		long long NbShortAccesses = 0;
+
+		std::map<size_t, long long> BlockCounts;
+		std::map<size_t, long long> CallCounts;	// Per function label : loops jumping back to it are only blocks.
+		std::map<std::pair<size_t, size_t>, long long> EdgeCounts;
+		std::map<std::string, long long> GlobalCounts;
+
+		bool ParseListing(std::istream& _In, Object& _Obj);
+		bool Fail(const std::string& _Error);
+		int* Register(const std::string& _Operand);
+		bool Value(const std::string& _Operand, int& _Value);
+		bool Address(const std::string& _Operand, unsigned int& _Address);
+		bool Access(const Instruction& _Instr, unsigned int _Address, int _Size);
+		bool Step(size_t& _PC, bool& _IsDone);
+		void EnterBlock(size_t _Label);
+
+	public:
+		bool LoadListing(const std::string& _Filename);
+		bool LoadListing(std::istream& _In, const std::string& _Name);
+		bool Run(const std::string& _Entry = "main", long long _MaxCycles = 1000000000);
+
+		const InstructionList& GetCode() const { return Code; }
+		int GetExitCode() const { return ExitCode; }
+		const std::string& GetError() const { return Error; }
+		void DumpStats(std::ostream& _Out) const;
+		bool WriteProfile(const std::string& _Filename) const;
+	};
+}
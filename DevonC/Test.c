@@ -13,14 +13,26 @@ Register now or call 0845 638 1421 to sign up and start using SMS text messaging
 namespace pegtl = TAO_PEGTL_NAMESPACE;
 using namespace pegtl;
 
-void testfunc(int a, char xxxx);
+static void testfunc(int a, char xxxx);
 
 int a, b = 0;		// xxxyyy
-char * xxx[0xFaB0][37];
-void** yyy = false;
+static char * xxx[0xFaB0][37];
+static void** yyy = false;
 void BadVar0;
 
-void testfunc(int a, char xxxx)
+struct Secondary
+{
+	int secondarymember;
+};
+
+struct Member
+{
+	struct Secondary mymember[4];
+};
+
+static struct Member Table[8][4];
+
+static void testfunc(int a, char xxxx)
 {
 xxxx:
 	break;
@@ -49,11 +61,129 @@ xxxx:
 		eslest;
 	}
 
-	for (int a = 39; 654; a[4][2].mymember[3].secondarymember = 897)
+	for (int a = 39; 654; Table[4][2].mymember[3].secondarymember = 897)
 	{
 	}
 } 
 
+int StateIdle(int frame, char input);
+
+int StateRun(int frame, char input)
+{
+	return StateIdle(frame, input);
+}
+
+int StateIdle(int frame, char input)
+{
+	if (input)
+		return StateRun(frame, input);
+
+	return StateIdle(frame, 0);
+}
+
+void FrameTest(int n)
+{
+	short Count;
+	{
+		int Scratch[4];
+		Count = Scratch[n];
+	}
+	{
+		char Name[5];
+		short Len;
+		Len = Name[0] + Count;
+		Count = Len;
+	}
+	for (int i = 0; i < 8; i = i + 1)
+	{
+		char Temp;
+		Temp = i;
+		Count = Count + Temp;
+	}
+}
+
+#define GRID_WIDTH 16
+#define CELL(x, y) ((y) * GRID_WIDTH + (x))
+#define WIDE_CALL(name) Wide##name
+
+short Wide(int x, int y, int z);
+
+#if defined(GRID_WIDTH) && GRID_WIDTH > 8
+short WIDE_CALL(Cell)(int x, int y)
+{
+	return CELL(x,
+		y);
+}
+#else
+this region is skipped without being tokenized {{{
+#endif
+
+int Dispatch(int state, char input)
+{
+	switch (state)
+	{
+	case 0:
+		return StateIdle(0, input);
+	case 1:
+	case 2:
+		return StateRun(state, input);
+	case 3:
+		break;
+	case 5:
+		state = 0;
+	default:
+		return -1;
+	}
+
+	switch (input)
+	{
+	case 'q': return 0;
+	case 'x': return 1;
+	case 'q': return 2;
+	}
+	return state;
+}
+
+struct Point
+{
+	short x, y;
+};
+
+struct [[reorder]] Sprite
+{
+	char visible;
+	struct Point pos;
+	int frame;
+	char layer;
+	struct Point speed;
+};
+
+struct Sprite Sprites[4];
+
+void Animate(int n)
+{
+	while (n)
+	{
+		Sprites[n].pos.x = Sprites[n].pos.x + Sprites[n].speed.x;
+		n = n - 1;
+	}
+	Sprites[0].layer = 1;
+}
+
+int Cells[4][8];
+
+void Refresh(int n)
+{
+	Cells[n][2] = Cells[n][2] + n * 8;
+	StateIdle(n, 0);
+	Cells[n][3] = Cells[n][2] + n * 8;
+}
+
+short Narrow(char c)
+{
+	return Wide(c, c, c);
+}
+
 int main(int argc/*, char* argv[]*/)
 {
 	a = 356, b = true;
@@ -62,5 +192,14 @@ int main(int argc/*, char* argv[]*/)
 	w = !36 < 12;
 	d = f(x, 39) % 32 * (a + b);
 
+	if (false)
+		testfunc(a, 'x');
+
+	FrameTest(StateRun(0, 'a'));
+	Narrow(b);
+	Refresh(a);
+	Dispatch(a, 'q');
+	Animate(3);
+
 	return false;
 }
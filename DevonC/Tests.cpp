@@ -0,0 +1,515 @@
+#include "Tests.h"
+#include "Compiler.h"
+#include "IncludeSearch.h"
+#include "Linker.h"
+#include "Object.h"
+#include "Parallel.h"
+#include "Peephole.h"
+#include "Preprocessor.h"
+#include "Simulator.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace DevonC;
+
+namespace
+{
+	struct TestRun
+	{
+		int NbChecks = 0;
+		int NbFailed = 0;
+
+		bool Check(bool _IsOk, const std::string& _Name, const std::string& _Details = "")
+		{
+			NbChecks++;
+			if (!_IsOk)
+			{
+				NbFailed++;
+				std::cout << "FAILED " << _Name << (_Details.empty() ? "" : " : " + _Details) << "\n";
+			}
+			return _IsOk;
+		}
+	};
+}
+
+// Same format as Compiler::WriteListing.
+static std::string ListingText(const InstructionList& _Code)
+{
+	std::string Text;
+	for (const auto& Instr : _Code)
+	{
+		if (Instr.Class == OpClass::Label)
+			Text += Instr.Dst + ":\n";
+		else
+			Text += "\t" + Instr.Opcode + (Instr.Dst.empty() ? "" : " " + Instr.Dst) + (Instr.Src.empty() ? "" : ", " + Instr.Src) + "\n";
+	}
+	return Text;
+}
+
+static bool RunListing(const std::string& _Listing, int& _ExitCode, std::string& _Error)
+{
+	Simulator Sim;
+	std::istringstream In(_Listing);
+	if (!Sim.LoadListing(In, "test") || !Sim.Run())
+	{
+		_Error = Sim.GetError();
+		return false;
+	}
+
+	_ExitCode = Sim.GetExitCode();
+	return true;
+}
+
+// The listing goes through the peephole optimizer, which must give _Expected back. Both listings are run
+// in the simulator : the optimized one must still be accepted, and exit with the same code.
+static void CheckPeephole(TestRun& _Run, const std::string& _Name, const std::string& _Listing, const std::string& _Expected)
+{
+	Simulator Parsed;
+	std::istringstream In(_Listing);
+	if (!_Run.Check(Parsed.LoadListing(In, _Name), _Name, "bad listing : " + Parsed.GetError()))
+		return;
+
+	InstructionList Code = Parsed.GetCode();
+	Peephole Opt;
+	Opt.Run(Code);
+	const std::string Optimized = ListingText(Code);
+	_Run.Check(Optimized == _Expected, _Name, "got\n" + Optimized + "expected\n" + _Expected);
+
+	int Before = 0, After = 0;
+	std::string Error;
+	if (!_Run.Check(RunListing(_Listing, Before, Error), _Name, "original run : " + Error)
+		|| !_Run.Check(RunListing(Optimized, After, Error), _Name, "optimized run : " + Error))
+		return;
+
+	_Run.Check(Before == After, _Name, "exit code " + std::to_string(After) + " instead of " + std::to_string(Before));
+}
+
+static void TestPeephole(TestRun& _Run)
+{
+	CheckPeephole(_Run, "store-load",
+		"main:\n\tmov r1, #-1000000\n\tst.l [100], r1\n\tld.l r0, [100]\n\tret\n",
+		"main:\n\tmov r1, #-1000000\n\tst.l [100], r1\n\tmov r0, r1\n\tret\n");
+
+	// A 16-bit load gives back the low half of r1, sign-extended : not r1.
+	CheckPeephole(_Run, "store-load, narrow",
+		"main:\n\tmov r1, #70000\n\tst [100], r1\n\tld r0, [100]\n\tret\n",
+		"main:\n\tmov r1, #70000\n\tst [100], r1\n\tld r0, [100]\n\tret\n");
+
+	CheckPeephole(_Run, "load-store",
+		"main:\n\tmov r1, #0x1234\n\tst [100], r1\n\tld.b r2, [100]\n\tst.b [100], r2\n\tld r0, [100]\n\tret\n",
+		"main:\n\tmov r1, #0x1234\n\tst [100], r1\n\tld.b r2, [100]\n\tld r0, [100]\n\tret\n");
+
+	// Storing the loaded byte as a word clears the byte above it.
+	CheckPeephole(_Run, "load-store, sizes differ",
+		"main:\n\tmov r1, #0x1234\n\tst [100], r1\n\tld.b r2, [100]\n\tst [100], r2\n\tld r0, [100]\n\tret\n",
+		"main:\n\tmov r1, #0x1234\n\tst [100], r1\n\tld.b r2, [100]\n\tst [100], r2\n\tld r0, [100]\n\tret\n");
+
+	// The load replaces the address register : the store goes to the loaded address, not back where it loaded.
+	CheckPeephole(_Run, "load-store, address register loaded",
+		"main:\n\tmov r1, #200\n\tst [100], r1\n\tmov r0, #100\n\tld r0, [r0]\n\tst [r0], r0\n\tld r0, [200]\n\tret\n",
+		"main:\n\tmov r1, #200\n\tst [100], r1\n\tmov r0, #100\n\tld r0, [r0]\n\tst [r0], r0\n\tld r0, [200]\n\tret\n");
+
+	CheckPeephole(_Run, "self-move",
+		"main:\n\tmov r0, #7\n\tmov r0, r0\n\tret\n",
+		"main:\n\tmov r0, #7\n\tret\n");
+
+	CheckPeephole(_Run, "jump-next",
+		"main:\n\tmov r0, #3\n\tjmp next\nnext:\n\tret\n",
+		"main:\n\tmov r0, #3\nnext:\n\tret\n");
+
+	CheckPeephole(_Run, "branch-next",
+		"main:\n\tmov r0, #4\n\tcmp r0, #4\n\tbeq next\nnext:\n\tret\n",
+		"main:\n\tmov r0, #4\n\tcmp r0, #4\nnext:\n\tret\n");
+
+	CheckPeephole(_Run, "compare-zero",
+		"main:\n\tmov r0, #-5\n\tadd r0, #5\n\tcmp r0, #0\n\tbeq zero\n\tmov r0, #1\n\tret\nzero:\n\tmov r0, #2\n\tret\n",
+		"main:\n\tmov r0, #-5\n\tadd r0, #5\n\tbeq zero\n\tmov r0, #1\n\tret\nzero:\n\tmov r0, #2\n\tret\n");
+}
+
+// Writes _Obj, lets _Corrupt patch the bytes, and reads it back.
+static bool ReadBackObject(const Object& _Obj, void (*_Corrupt)(std::string&))
+{
+	const char* Filename = "DevonC-test.o";
+	if (!_Obj.Write(Filename))
+		return false;
+
+	std::string Bytes;
+	{
+		std::ifstream In(Filename, std::ios::binary);
+		Bytes.assign(std::istreambuf_iterator<char>(In), std::istreambuf_iterator<char>());
+	}
+	if (_Corrupt != nullptr)
+		_Corrupt(Bytes);
+	{
+		std::ofstream Out(Filename, std::ios::binary);
+		Out.write(Bytes.data(), Bytes.size());
+	}
+
+	Object Read;
+	const bool IsRead = Read.Read(Filename);
+	std::remove(Filename);
+	return IsRead;
+}
+
+static void TestObjectReader(TestRun& _Run)
+{
+	Object Obj;
+	const int Text = Obj.AddSection(".text.main", 2, false);
+	Obj.Sections[Text].Data = { 1, 2, 3, 4 };
+	const int Main = Obj.AddSymbol("main");
+	Obj.Symbols[Main].Section = Text;
+	Obj.AddRelocation(Text, 0, Obj.AddSymbol("extern"), RelocType::Abs16);
+
+	_Run.Check(ReadBackObject(Obj, nullptr), "object : read back");
+
+	// The three counts follow the 4-byte magic.
+	_Run.Check(!ReadBackObject(Obj, [](std::string& _Bytes) { _Bytes[7] = '\x7F'; }), "object : section count past the end");
+	_Run.Check(!ReadBackObject(Obj, [](std::string& _Bytes) { _Bytes[11] = '\x7F'; }), "object : symbol count past the end");
+	_Run.Check(!ReadBackObject(Obj, [](std::string& _Bytes) { _Bytes[15] = '\x7F'; }), "object : relocation count past the end");
+
+	Object BadSection = Obj;
+	BadSection.Symbols[Main].Section = -2;
+	_Run.Check(!ReadBackObject(BadSection, nullptr), "object : symbol section below -1");
+}
+
+// Runs the preprocessor on _Source as the only file of a translation unit. Errors come out as "line : message".
+static std::string Preprocess(const std::string& _Source, std::string& _Errors)
+{
+	PreprocessorHost Host;
+	Host.Load = [&_Source](const std::string&) { return _Source; };
+	Host.FindInclude = [](const std::string& _Name, const std::string&, bool) { return _Name; };
+	Host.Error = [&_Errors](const std::string&, size_t _Line, const std::string& _Message) { _Errors += std::to_string(_Line) + " : " + _Message + "\n"; };
+
+	Preprocessor Macros;
+	std::deque<PreprocessedFile> Files;
+	Macros.Run("test.c", Host, Files);
+	return Files.empty() ? "" : Files.front().Text;
+}
+
+static void CheckPreprocess(TestRun& _Run, const std::string& _Name, const std::string& _Source, const std::string& _Expected)
+{
+	std::string Errors;
+	const std::string Text = Preprocess(_Source, Errors);
+	_Run.Check(Text == _Expected && Errors.empty(), "preprocessor : " + _Name, "got\n" + Text + Errors + "expected\n" + _Expected);
+}
+
+static void CheckPreprocessError(TestRun& _Run, const std::string& _Name, const std::string& _Source, const std::string& _Error)
+{
+	std::string Errors;
+	Preprocess(_Source, Errors);
+	_Run.Check(Errors.find(_Error) != std::string::npos, "preprocessor : " + _Name, Errors.empty() ? "no error" : Errors);
+}
+
+static void TestPreprocessor(TestRun& _Run)
+{
+	// Directives and skipped lines stay as blank lines.
+	CheckPreprocess(_Run, "stringize", "#define STR(x) #x\nSTR(a + \"b\")\n", "\n\"a + \\\"b\\\"\"\n");
+	CheckPreprocess(_Run, "paste", "#define CAT(a, b) a ## b\nint CAT(x, 1) = CAT(1, 2);\n", "\nint x1 = 12;\n");
+	CheckPreprocess(_Run, "variadic", "#define CALL(f, ...) f(__VA_ARGS__)\nCALL(g, 1, (2, 3), 4);\nCALL(h);\n", "\ng(1, (2, 3), 4);\nh();\n");
+	CheckPreprocess(_Run, "nested conditionals", "#if 1\n#if 0\na\n#else\nb\n#endif\n#else\nc\n#endif\n", "\n\n\n\nb\n\n\n\n\n");
+	CheckPreprocess(_Run, "elif", "#define V 2\n#if V == 1\na\n#elif V == 2\nb\n#elif V == 2\nc\n#else\nd\n#endif\n", "\n\n\n\nb\n\n\n\n\n\n");
+
+	// Shifts and divisions whose result C leaves undefined.
+	CheckPreprocessError(_Run, "negative shift", "#if 1 << -1\n#endif\n", "invalid #if expression");
+	CheckPreprocessError(_Run, "shift by 64", "#if 1 >> 64\n#endif\n", "invalid #if expression");
+	CheckPreprocessError(_Run, "LLONG_MIN / -1", "#if (-9223372036854775807 - 1) / -1\n#endif\n", "invalid #if expression");
+	CheckPreprocessError(_Run, "LLONG_MIN % -1", "#if (-9223372036854775807 - 1) % -1\n#endif\n", "invalid #if expression");
+	CheckPreprocess(_Run, "shift by 63", "#if (1 << 63) < 0\na\n#endif\n", "\na\n\n");
+}
+
+// A directory named like the include is skipped : the file comes from the next path.
+static void TestIncludeSearch(TestRun& _Run)
+{
+	std::error_code Error;
+	std::filesystem::create_directories("DevonC-test-inc/first/stdio.h", Error);
+	std::filesystem::create_directories("DevonC-test-inc/second", Error);
+	std::ofstream("DevonC-test-inc/second/stdio.h") << "\n";
+
+	IncludeSearch Search;
+	Search.AddPath("DevonC-test-inc/first", false);
+	Search.AddPath("DevonC-test-inc/second", false);
+	const std::string Found = Search.Find("stdio.h", "test.c", true);
+	std::filesystem::remove_all("DevonC-test-inc", Error);
+
+	_Run.Check(Found == "DevonC-test-inc/second/stdio.h", "include search : directory skipped", Found);
+}
+
+// Includes under "#if 0" are not prefetched, those of its #else branch and of the code around it are.
+static void TestPrefetchScan(TestRun& _Run)
+{
+	const std::string Source = "#include \"a.h\"\n#if 0\n#include \"b.h\"\n#ifdef X\n#include \"c.h\"\n#endif\n"
+		"#else\n#include <d.h>\n#endif\n#include \"e.h\"\n";
+	IncludeScan Scan;
+	string_input SourceInput(Source, "");
+	parse<prefetchscan, prefetchaction>(SourceInput, Scan);
+
+	std::string Found;
+	for (const auto& Include : Scan.Includes)
+		Found += Include.first + (Include.second ? "<> " : " ");
+	_Run.Check(Found == "a.h d.h<> e.h ", "prefetch : #if 0 skipped", Found);
+}
+
+// Compiles _Source as a file of its own, traces off, and returns what the compiler reports : errors, then DumpDebug.
+static std::string CompileSample(const std::string& _Source)
+{
+	const char* Filename = "DevonC-test.c";
+	{
+		std::ofstream Out(Filename);
+		Out << _Source;
+	}
+
+	std::ostringstream Report;
+	std::streambuf* const Cout = std::cout.rdbuf(Report.rdbuf());
+	SetDebugLog(false);
+	{
+		Compiler Sample;
+		Sample.Compile(Filename);
+		Sample.Optimize();
+		Sample.DumpDebug();
+	}
+	SetDebugLog(true);
+	std::cout.rdbuf(Cout);
+
+	std::remove(Filename);
+	return Report.str();
+}
+
+// A store through a pointer changes memory for good : the pointer is read, and kept.
+static void TestDeadStores(TestRun& _Run)
+{
+	const std::string Report = CompileSample(
+		"static int* gp;\n"
+		"void f()\n"
+		"{\n"
+		"\tint* p;\n"
+		"\tint x;\n"
+		"\tp = nullptr;\n"
+		"\tp[0] = 5;\n"
+		"\tgp[0] = 7;\n"
+		"\tx = 3;\n"
+		"}\n");
+
+	_Run.Check(Report.find("1 dead store\n") != std::string::npos, "dead stores : only the whole-variable store to x", Report);
+	_Run.Check(Report.find("gp (unused)") == std::string::npos && Report.find("\t\tp (unused)") == std::string::npos,
+		"dead stores : pointers stored through are kept", Report);
+}
+
+static void TestValueNumbering(TestRun& _Run)
+{
+	const std::string Report = CompileSample(
+		"int g;\n"
+		"void f(int* p, int i)\n"
+		"{\n"
+		"\tint x;\n"
+		"\tint y;\n"
+		"\tx = g + i;\n"
+		"\ty = g + i;\n"
+		"\tx = g + i;\n"
+		"\tp[0] = 5;\n"
+		"\ty = g + i;\n"
+		"}\n");
+
+	_Run.Check(Report.find("Line 7 : g + i reuses the value of line 6") != std::string::npos, "value numbering : reuse", Report);
+	_Run.Check(Report.find("Line 10 :") == std::string::npos, "value numbering : store through a pointer drops globals", Report);
+
+	// A while or for body may not run, or stop before the value : only a do-while body always runs it.
+	const std::string Loops = CompileSample(
+		"int g;\n"
+		"int h;\n"
+		"void f(int c)\n"
+		"{\n"
+		"\tint x;\n"
+		"\tint y;\n"
+		"\twhile (c) { x = g + h; }\n"
+		"\ty = g + h;\n"
+		"\tfor (x = 0; x < 4; x = x + 1) { if (c) break; y = g * h; }\n"
+		"\ty = g * h;\n"
+		"\tdo { x = g - h; } while (c);\n"
+		"\ty = g - h;\n"
+		"}\n");
+
+	_Run.Check(Loops.find("Line 8 :") == std::string::npos, "value numbering : while body may not run", Loops);
+	_Run.Check(Loops.find("Line 10 :") == std::string::npos, "value numbering : for body may break first", Loops);
+	_Run.Check(Loops.find("Line 12 : g - h reuses the value of line 11") != std::string::npos, "value numbering : do-while body always runs", Loops);
+}
+
+static void CheckStructError(TestRun& _Run, const std::string& _Name, const std::string& _Source, const std::string& _Error)
+{
+	const std::string Report = CompileSample(_Source);
+	_Run.Check(Report.find(_Error) != std::string::npos, "structs : " + _Name, Report);
+}
+
+static void TestStructs(TestRun& _Run)
+{
+	// The reordered struct is laid out when its definition ends, before the one containing it.
+	const std::string Report = CompileSample(
+		"struct [[reorder]] Inner { char a; short b; char c; };\n"
+		"struct Outer { struct Inner in; short tail; };\n"
+		"struct Outer O;\n"
+		"int main() { O.in.a = 1; return O.tail; }\n");
+	_Run.Check(Report.find("Inner : 4 bytes, reordered from 6 bytes") != std::string::npos
+		&& Report.find("Outer : 6 bytes") != std::string::npos
+		&& Report.find("[+4] Short tail") != std::string::npos, "structs : nested reordered layout", Report);
+
+	// The '&' takes the address of s, not of the index : s lives on while use() runs.
+	const std::string Address = CompileSample(
+		"struct S { int a[4]; int b; };\n"
+		"int gi;\n"
+		"int use(int* q);\n"
+		"int f(int c) { struct S s; s.b = c; return use(&s.a[gi]); }\n");
+	_Run.Check(Address.find("-> call") != std::string::npos && Address.find("-> jump") == std::string::npos,
+		"structs : address of an indexed member", Address);
+
+	CheckStructError(_Run, "member of a non-struct", "int a;\nvoid f() { a[1].x = 1; }\n", "Member 'x' accessed on a value that is not a struct.");
+	CheckStructError(_Run, "unknown member", "struct S { int x; };\nstruct S s;\nvoid f() { s.y = 1; }\n", "Struct 'S' has no member 'y'.");
+	CheckStructError(_Run, "duplicate member", "struct S { int x; char x; };\n", "Duplicate member 'x' in struct 'S'.");
+	CheckStructError(_Run, "duplicate struct", "struct S { int x; };\nstruct S { int y; };\n", "Struct 'S' is already defined.");
+	CheckStructError(_Run, "unknown struct", "struct T t;\n", "Unknown struct 'T'.");
+}
+
+// Programs the simulator must stop cleanly on, with _Error in its message.
+static void CheckTrap(TestRun& _Run, const std::string& _Name, const std::string& _Listing, const std::string& _Error)
+{
+	int ExitCode = 0;
+	std::string Error;
+	const bool IsRun = RunListing(_Listing, ExitCode, Error);
+	_Run.Check(!IsRun && Error.find(_Error) != std::string::npos, "simulator : " + _Name, IsRun ? "ran to the end" : Error);
+}
+
+static void TestSimulatorTraps(TestRun& _Run)
+{
+	CheckTrap(_Run, "division by zero", "main:\n\tmov r0, #5\n\tmov r1, #0\n\tdiv r0, r1\n\tret\n", "division by zero");
+	CheckTrap(_Run, "INT_MIN / -1", "main:\n\tmov r0, #1\n\tshl r0, #31\n\tmov r1, #-1\n\tdiv r0, r1\n\tret\n", "division overflow");
+	CheckTrap(_Run, "INT_MIN % -1", "main:\n\tmov r0, #1\n\tshl r0, #31\n\tmov r1, #-1\n\tmod r0, r1\n\tret\n", "division overflow");
+
+	// The address plus the size wraps around to 1 in 32 bits.
+	CheckTrap(_Run, "access wrapping around", "main:\n\tmov r1, #-1\n\tld r0, [r1]\n\tret\n", "out of memory access");
+	CheckTrap(_Run, "runaway recursion", "main:\n\tcall main\n\tret\n", "call stack overflow");
+}
+
+// A loop jumping back to the function's own label only counts as blocks, not as calls.
+static void TestCallProfile(TestRun& _Run)
+{
+	Simulator Sim;
+	std::istringstream In("main:\n\tcall f\n\tcall f\n\tcall f\n\tret\nf:\n\tadd r1, #1\n\tcmp r1, #10\n\tblt f\n\tmov r1, #0\n\tret\n");
+	const char* Filename = "DevonC-test.prof";
+	if (!_Run.Check(Sim.LoadListing(In, "test") && Sim.Run() && Sim.WriteProfile(Filename), "profile : run", Sim.GetError()))
+		return;
+
+	std::ifstream Profile(Filename);
+	const std::string Text((std::istreambuf_iterator<char>(Profile)), std::istreambuf_iterator<char>());
+	Profile.close();
+	std::remove(Filename);
+
+	_Run.Check(Text.find("call f 3\n") != std::string::npos && Text.find("block f 30\n") != std::string::npos, "profile : calls apart from back edges", Text);
+}
+
+// Whatever the number of workers, the exception of the lowest failing index reaches the caller.
+static void TestParallelFor(TestRun& _Run)
+{
+	for (const int NbWorkers : { 1, 4 })
+	{
+		std::string Caught;
+		try
+		{
+			ParallelFor(100, NbWorkers, [](size_t _Index, int)
+			{
+				if (_Index == 30 || _Index == 70)
+					throw std::runtime_error(std::to_string(_Index));
+			});
+		}
+		catch (std::exception& err)
+		{
+			Caught = err.what();
+		}
+
+		_Run.Check(Caught == "30", "ParallelFor : rethrown with " + std::to_string(NbWorkers) + " workers", Caught);
+	}
+}
+
+// Two objects each filling the window with candidates : the hottest per byte of both get it, starting past the null word.
+static void TestShortWindow(TestRun& _Run)
+{
+	Linker Link;
+	for (int o = 0; o < 2; o++)
+	{
+		Object Obj;
+		const int Text = Obj.AddSection(o == 0 ? ".text.main" : ".text.other", 2, false);
+		const int Other = Obj.AddSymbol(o == 0 ? "other" : "main");
+		Obj.Symbols[Obj.AddSymbol(o == 0 ? "main" : "other")].Section = Text;
+		Obj.AddRelocation(Text, 0, Other, RelocType::None);
+
+		const std::string Suffix = std::to_string(o);
+		const std::string Names[] = { "hot" + Suffix, "cold" + Suffix };
+		const int Sizes[] = { 4, 200 };
+		for (int g = 0; g < 2; g++)
+		{
+			const int Section = Obj.AddSection(".short." + Names[g], 2, false);
+			Obj.Sections[Section].Data.resize(Sizes[g], 0);
+			Obj.Sections[Section].AccessWeight = g == 0 ? 1000 + o : 10;
+			const int Symbol = Obj.AddSymbol(Names[g]);
+			Obj.Symbols[Symbol].Section = Section;
+			Obj.AddRelocation(Text, 0, Symbol, RelocType::None);
+		}
+
+		Link.AddObject(std::move(Obj), "window" + Suffix + ".o");
+	}
+
+	if (!_Run.Check(Link.Link(), "short window : link"))
+		return;
+
+	unsigned int Hot0 = 0, Hot1 = 0, Cold0 = 0, Cold1 = 0;
+	Link.FindSymbolAddress("hot0", Hot0);
+	Link.FindSymbolAddress("hot1", Hot1);
+	Link.FindSymbolAddress("cold0", Cold0);
+	Link.FindSymbolAddress("cold1", Cold1);
+	_Run.Check(Hot0 >= ShortWindowStart && Hot1 >= ShortWindowStart && Hot0 < ShortAddressWindow && Hot1 < ShortAddressWindow,
+		"short window : hot globals in the window, past null", std::to_string(Hot0) + ", " + std::to_string(Hot1));
+	// Both cold ones weigh the same : the first one fits, the second one goes with .data, after the window.
+	_Run.Check(Cold0 + 200 <= ShortAddressWindow && Cold1 > Hot0 && Cold1 > Hot1 && Cold1 > Cold0, "short window : one cold global left out",
+		std::to_string(Cold0) + ", " + std::to_string(Cold1));
+}
+
+// The relocated field runs past the end of its section, into the one placed after it.
+static void TestRelocationBounds(TestRun& _Run)
+{
+	Object Obj;
+	const int Main = Obj.AddSection(".text.main", 2, false);
+	const int After = Obj.AddSection(".text.after", 2, false);
+	Obj.Sections[Main].Data.resize(2, 0);
+	Obj.Sections[After].Data.resize(4, 0);
+	Obj.Symbols[Obj.AddSymbol("main")].Section = Main;
+	const int Target = Obj.AddSymbol("after");
+	Obj.Symbols[Target].Section = After;
+	Obj.AddRelocation(Main, 2, Target, RelocType::Abs16);
+
+	Linker Link;
+	Link.AddObject(std::move(Obj), "bounds.o");
+	_Run.Check(!Link.Link(), "link : relocation past its section");
+}
+
+int DevonC::RunTests()
+{
+	TestRun Run;
+	TestPeephole(Run);
+	TestPreprocessor(Run);
+	TestIncludeSearch(Run);
+	TestPrefetchScan(Run);
+	TestDeadStores(Run);
+	TestValueNumbering(Run);
+	TestStructs(Run);
+	TestObjectReader(Run);
+	TestShortWindow(Run);
+	TestRelocationBounds(Run);
+	TestSimulatorTraps(Run);
+	TestCallProfile(Run);
+	TestParallelFor(Run);
+
+	std::cout << Run.NbChecks << " checks, " << Run.NbFailed << " failed.\n";
+	return Run.NbFailed;
+}
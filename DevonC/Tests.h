@@ -0,0 +1,8 @@
+#pragma once
+
+namespace DevonC
+{
+	// Self-checks run by "DevonC -test" : each one prints what went wrong, the result is the number of
+	// failed checks.
+	int RunTests();
+}